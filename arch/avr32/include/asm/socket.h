@@ -61,4 +61,8 @@
 #define SO_DOMAIN		39
 
 #define SO_RXQ_OVFL		40
+
+#define SO_BUSY_POLL		46
+
+#define SO_INCOMING_CPU		49
 #endif /* __ASM_AVR32_SOCKET_H */
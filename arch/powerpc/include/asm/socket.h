@@ -69,4 +69,8 @@
 
 #define SO_RXQ_OVFL		40
 
+#define SO_BUSY_POLL		46
+
+#define SO_INCOMING_CPU		49
+
 #endif	/* _ASM_POWERPC_SOCKET_H */
@@ -1851,6 +1851,9 @@ static u16 ixgbe_clean_test_rings(struct ixgbe_ring *rx_ring,
 	rx_ring->next_to_clean = rx_ntc;
 	tx_ring->next_to_clean = tx_ntc;
 
+	/* the test frames were not completed through ixgbe_clean_tx_irq() */
+	netdev_tx_reset_queue(txring_txq(tx_ring));
+
 	return count;
 }
 
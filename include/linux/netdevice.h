@@ -53,6 +53,7 @@
 #ifndef __GENKSYMS__
 #include <net/netprio_cgroup.h>
 #include <linux/neighbour.h>
+#include <linux/dynamic_queue_limits.h>
 #endif
 
 struct vlan_group;
@@ -493,8 +494,19 @@ enum netdev_queue_state_t
 {
 	__QUEUE_STATE_XOFF,
 	__QUEUE_STATE_FROZEN,
+	__QUEUE_STATE_STACK_XOFF,
 };
 
+/*
+ * __QUEUE_STATE_XOFF is owned by the driver (netif_tx_stop_queue() and
+ * friends); __QUEUE_STATE_STACK_XOFF is set by the stack when byte queue
+ * limits decide enough data is in flight to the device.
+ */
+#define QUEUE_STATE_ANY_XOFF	((1 << __QUEUE_STATE_XOFF) |		\
+				 (1 << __QUEUE_STATE_STACK_XOFF))
+#define QUEUE_STATE_ANY_XOFF_OR_FROZEN	(QUEUE_STATE_ANY_XOFF |		\
+					 (1 << __QUEUE_STATE_FROZEN))
+
 struct netdev_queue {
 /*
  * read mostly part
@@ -771,6 +783,13 @@ struct netdev_fcoe_hbainfo {
  *		       struct net_device *dev, int idx)
  *	Used to add FDB entries to dump requests. Implementers should add
  *	entries to skb and update idx with the number of entries.
+ *
+ * int (*ndo_busy_poll)(struct napi_struct *napi)
+ *	Called from a socket or poll context waiting for data to busy poll
+ *	the device queue behind @napi. Returns the number of packets
+ *	processed, LL_FLUSH_BUSY if the queue is owned by NAPI or another
+ *	poller, or LL_FLUSH_FAILED if the device is going down. Lives in
+ *	struct net_device_extended and is set with netdev_extended().
  */
 #define HAVE_NET_DEVICE_OPS
 struct net_device_ops {
@@ -1172,6 +1191,11 @@ struct net_device
 struct netdev_tx_queue_extended {
 	struct netdev_queue	*q;
 	struct kobject		kobj;
+#ifndef __GENKSYMS__
+#ifdef CONFIG_BQL
+	struct dql		dql;
+#endif
+#endif
 };
 
 struct netdev_rps_info {
@@ -1260,6 +1284,7 @@ struct net_device_extended {
 	struct netdev_rfs_info			rfs_data;
 #define GSO_MAX_SEGS		65535
 	u16			gso_max_segs;
+	int			(*ndo_busy_poll)(struct napi_struct *napi);
 };
 
 #define NET_DEVICE_EXTENDED_SIZE \
@@ -1294,6 +1319,14 @@ netdev_extended(const struct net_device *dev)
 	return netdev_extended_frozen(dev)->dev_ext;
 }
 
+static inline struct netdev_tx_queue_extended *
+netdev_tx_queue_extended(const struct netdev_queue *txq)
+{
+	const struct net_device *dev = txq->dev;
+
+	return netdev_extended(dev)->_tx_ext + (txq - dev->_tx);
+}
+
 extern void set_ethtool_ops_ext(struct net_device *, const struct ethtool_ops_ext *);
 extern const struct ethtool_ops_ext *get_ethtool_ops_ext(const struct net_device *);
 
@@ -1469,6 +1502,38 @@ void netif_napi_add(struct net_device *dev, struct napi_struct *napi,
  */
 void netif_napi_del(struct napi_struct *napi);
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+/**
+ *	napi_hash_add - add a NAPI to the global busy poll hash table
+ *	@napi: napi context
+ *
+ * Generate a new napi_id and register @napi for busy polling. Returns
+ * the id, which the driver must record in received skbs with
+ * skb_mark_napi_id(), or 0 if no id could be allocated.
+ */
+extern unsigned int napi_hash_add(struct napi_struct *napi);
+
+/**
+ *	napi_hash_del - remove a NAPI from the global busy poll hash table
+ *	@napi: napi context
+ *
+ * Warning: caller must observe an RCU grace period before freeing
+ * memory containing @napi, this function takes care of that, so it
+ * may sleep.
+ */
+extern void napi_hash_del(struct napi_struct *napi);
+extern struct napi_struct *napi_by_id(unsigned int napi_id);
+#else
+static inline unsigned int napi_hash_add(struct napi_struct *napi)
+{
+	return 0;
+}
+
+static inline void napi_hash_del(struct napi_struct *napi)
+{
+}
+#endif
+
 struct napi_gro_cb {
 	/* Virtual address of skb_shinfo(skb)->frags[0].page + offset. */
 	void *frag0;
@@ -1709,7 +1774,7 @@ extern void __netif_schedule(struct Qdisc *q);
 
 static inline void netif_schedule_queue(struct netdev_queue *txq)
 {
-	if (!test_bit(__QUEUE_STATE_XOFF, &txq->state))
+	if (!(txq->state & QUEUE_STATE_ANY_XOFF))
 		__netif_schedule(txq->qdisc);
 }
 
@@ -1829,6 +1894,124 @@ static inline int netif_tx_queue_frozen(const struct netdev_queue *dev_queue)
 	return test_bit(__QUEUE_STATE_FROZEN, &dev_queue->state);
 }
 
+/*
+ * The netif_xmit_*() helpers are for the stack: they also honour the
+ * byte queue limit state, which drivers never see through
+ * netif_tx_queue_stopped().
+ */
+static inline int netif_xmit_stopped(const struct netdev_queue *dev_queue)
+{
+	return dev_queue->state & QUEUE_STATE_ANY_XOFF;
+}
+
+static inline int
+netif_xmit_frozen_or_stopped(const struct netdev_queue *dev_queue)
+{
+	return dev_queue->state & QUEUE_STATE_ANY_XOFF_OR_FROZEN;
+}
+
+/**
+ *	netdev_tx_sent_queue - account bytes handed to the hardware
+ *	@dev_queue: transmit queue
+ *	@bytes: number of bytes just queued to the device ring
+ *
+ *	Called by drivers from their transmit routine once a packet has
+ *	been placed on the ring. Stops the queue from the stack side when
+ *	the byte queue limit is exceeded.
+ */
+static inline void netdev_tx_sent_queue(struct netdev_queue *dev_queue,
+					unsigned int bytes)
+{
+#ifdef CONFIG_BQL
+	struct dql *dql = &netdev_tx_queue_extended(dev_queue)->dql;
+
+	dql_queued(dql, bytes);
+
+	if (likely(dql_avail(dql) >= 0))
+		return;
+
+	set_bit(__QUEUE_STATE_STACK_XOFF, &dev_queue->state);
+
+	/*
+	 * The XOFF flag must be set before checking the dql_avail below,
+	 * because in netdev_tx_completed_queue we update the dql_completed
+	 * before checking the XOFF flag.
+	 */
+	smp_mb();
+
+	/* check again in case another CPU has just made room avail */
+	if (unlikely(dql_avail(dql) >= 0))
+		clear_bit(__QUEUE_STATE_STACK_XOFF, &dev_queue->state);
+#endif
+}
+
+static inline void netdev_sent_queue(struct net_device *dev, unsigned int bytes)
+{
+	netdev_tx_sent_queue(netdev_get_tx_queue(dev, 0), bytes);
+}
+
+/**
+ *	netdev_tx_completed_queue - account bytes completed by the hardware
+ *	@dev_queue: transmit queue
+ *	@pkts: number of packets reclaimed
+ *	@bytes: number of bytes reclaimed
+ *
+ *	Called by drivers from their TX completion routine. Must be given
+ *	the same byte counts that were passed to netdev_tx_sent_queue().
+ */
+static inline void netdev_tx_completed_queue(struct netdev_queue *dev_queue,
+					     unsigned int pkts,
+					     unsigned int bytes)
+{
+#ifdef CONFIG_BQL
+	struct dql *dql = &netdev_tx_queue_extended(dev_queue)->dql;
+
+	if (unlikely(!bytes))
+		return;
+
+	dql_completed(dql, bytes);
+
+	/*
+	 * Without the memory barrier there is a small possiblity that
+	 * netdev_tx_sent_queue will miss the update and cause the queue to
+	 * be stopped forever
+	 */
+	smp_mb();
+
+	if (dql_avail(dql) < 0)
+		return;
+
+	if (test_and_clear_bit(__QUEUE_STATE_STACK_XOFF, &dev_queue->state))
+		netif_schedule_queue(dev_queue);
+#endif
+}
+
+static inline void netdev_completed_queue(struct net_device *dev,
+					  unsigned int pkts, unsigned int bytes)
+{
+	netdev_tx_completed_queue(netdev_get_tx_queue(dev, 0), pkts, bytes);
+}
+
+/**
+ *	netdev_tx_reset_queue - reset the byte queue limit state
+ *	@dev_queue: transmit queue
+ *
+ *	Must be called by drivers whenever they drop the contents of the
+ *	ring without going through their completion path, e.g. on reset.
+ */
+static inline void netdev_tx_reset_queue(struct netdev_queue *dev_queue)
+{
+#ifdef CONFIG_BQL
+	clear_bit(__QUEUE_STATE_STACK_XOFF, &dev_queue->state);
+	dql_reset(&netdev_tx_queue_extended(dev_queue)->dql);
+#endif
+}
+
+static inline void netdev_reset_queue(struct net_device *dev)
+{
+	netdev_tx_reset_queue(netdev_get_tx_queue(dev, 0));
+}
+
 /**
  *	netif_running - test if up
  *	@dev: network device
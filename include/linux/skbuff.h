@@ -357,6 +357,7 @@ typedef unsigned char *sk_buff_data_t;
  *	@ndisc_nodetype: router type (from link layer)
  *	@dma_cookie: a cookie to one of several possible DMA operations
  *		done by skb DMA functions
+ *	@napi_id: id of the NAPI struct this skb came from
  *	@secmark: security marking
  *	@vlan_tci: vlan tag control information
  */
@@ -400,11 +401,23 @@ struct sk_buff {
 				ip_summed:2,
 				nohdr:1,
 				nfctinfo:3;
+
+	/* pkt_type and protocol are read by the BPF JIT, which needs
+	 * their offsets. If you move them, move the markers with them.
+	 */
+#define PKT_TYPE_OFFSET()	offsetof(struct sk_buff, __pkt_type_offset)
+#define PROTOCOL_OFFSET()	offsetof(struct sk_buff, __protocol_offset)
+#ifndef __GENKSYMS__
+	__u8			__pkt_type_offset[0];
+#endif
 	__u8			pkt_type:3,
 				fclone:2,
 				ipvs_property:1,
 				peeked:1,
 				nf_trace:1;
+#ifndef __GENKSYMS__
+	__be16			__protocol_offset[0];
+#endif
 	__be16			protocol:16;
 	kmemcheck_bitfield_end(flags1);
 
@@ -446,9 +459,18 @@ struct sk_buff {
 
 	/* 0/13 bit hole */
 
+#ifdef __GENKSYMS__
 #ifdef CONFIG_NET_DMA
 	dma_cookie_t		dma_cookie;
 #endif
+#else
+#if defined(CONFIG_NET_DMA) || defined(CONFIG_NET_RX_BUSY_POLL)
+	union {
+		unsigned int	napi_id;
+		dma_cookie_t	dma_cookie;
+	};
+#endif
+#endif
 #ifdef CONFIG_NETWORK_SECMARK
 	__u32			secmark;
 #endif
@@ -2342,6 +2364,21 @@ static inline bool skb_rx_queue_recorded(const struct sk_buff *skb)
 	return (skb->queue_mapping != 0);
 }
 
+extern void __skb_get_rxhash(struct sk_buff *skb, int nhoff);
+
+/*
+ * Flow hash of a packet whose network header has been set, as used by
+ * RPS. Computed on first use and cached in skb->rxhash; zero means the
+ * packet could not be hashed.
+ */
+static inline u16 skb_get_rxhash(struct sk_buff *skb)
+{
+	if (!skb->rxhash)
+		__skb_get_rxhash(skb, skb_network_offset(skb));
+
+	return skb->rxhash;
+}
+
 extern u16 skb_tx_hash(const struct net_device *dev,
 		       const struct sk_buff *skb);
 extern u16 __skb_tx_hash(const struct net_device *dev,
@@ -0,0 +1,162 @@
+/*
+ * net busy poll support
+ *
+ * Allows a socket waiting for data to poll the device queue the last
+ * packet arrived on instead of sleeping until the next interrupt, at
+ * the cost of some cpu time and power.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#ifndef _LINUX_NET_BUSY_POLL_H
+#define _LINUX_NET_BUSY_POLL_H
+
+#include <linux/netdevice.h>
+#include <linux/sched.h>
+#include <net/sock.h>
+
+#ifdef CONFIG_NET_RX_BUSY_POLL
+
+extern unsigned int sysctl_net_busy_read __read_mostly;
+extern unsigned int sysctl_net_busy_poll __read_mostly;
+
+/* return values from ndo_busy_poll */
+#define LL_FLUSH_FAILED		-1
+#define LL_FLUSH_BUSY		-2
+
+static inline bool net_busy_loop_on(void)
+{
+	return sysctl_net_busy_poll;
+}
+
+/* a wrapper to make debug_smp_processor_id() happy;
+ * we can use sched_clock() because we don't care much about precision,
+ * we only care that the average is bounded
+ */
+static inline unsigned long busy_loop_us_clock(void)
+{
+	u64 rc;
+
+#ifdef CONFIG_DEBUG_PREEMPT
+	preempt_disable_notrace();
+	rc = sched_clock();
+	preempt_enable_no_resched_notrace();
+#else
+	rc = sched_clock();
+#endif
+	return rc >> 10;
+}
+
+/* in poll/select we use the global sysctl_net_busy_poll value */
+static inline bool busy_loop_timeout(unsigned long start_time)
+{
+	unsigned long bp_usec = ACCESS_ONCE(sysctl_net_busy_poll);
+
+	if (bp_usec) {
+		unsigned long end_time = start_time + bp_usec;
+		unsigned long now = busy_loop_us_clock();
+
+		return time_after(now, end_time);
+	}
+	return true;
+}
+
+/* in socket reads we use the per socket sk_ll_usec value */
+static inline bool sk_busy_loop_timeout(struct sock *sk,
+					unsigned long start_time)
+{
+	unsigned long bp_usec = ACCESS_ONCE(sk_extended(sk)->sk_ll_usec);
+
+	if (bp_usec) {
+		unsigned long end_time = start_time + bp_usec;
+		unsigned long now = busy_loop_us_clock();
+
+		return time_after(now, end_time);
+	}
+	return true;
+}
+
+static inline bool sk_can_busy_loop(struct sock *sk)
+{
+	return sk_extended(sk)->sk_ll_usec && sk_extended(sk)->sk_napi_id &&
+	       !signal_pending(current);
+}
+
+/* Busy poll the device queue identified by @napi_id until @loop_end
+ * returns true, the caller needs to reschedule or the queue reports
+ * it is going down. @loop_end is passed the busy_loop_us_clock() value
+ * the loop started at; a NULL @loop_end polls the queue exactly once.
+ * Returns true if any packet was processed.
+ */
+extern bool napi_busy_loop(unsigned int napi_id,
+			   bool (*loop_end)(void *, unsigned long),
+			   void *loop_end_arg);
+
+extern bool sk_busy_loop_end(void *p, unsigned long start_time);
+
+/* when used in sock_poll() nonblock is known at compile time to be true
+ * so the loop end check will be optimized out
+ */
+static inline bool sk_busy_loop(struct sock *sk, int nonblock)
+{
+	unsigned int napi_id = ACCESS_ONCE(sk_extended(sk)->sk_napi_id);
+
+	if (napi_id)
+		napi_busy_loop(napi_id, nonblock ? NULL : sk_busy_loop_end,
+			       sk);
+	return !skb_queue_empty(&sk->sk_receive_queue);
+}
+
+/* used in the NIC receive handler to mark the skb */
+static inline void skb_mark_napi_id(struct sk_buff *skb,
+				    unsigned int napi_id)
+{
+	skb->napi_id = napi_id;
+}
+
+/* used in the protocol handler to propagate the napi_id to the socket */
+static inline void sk_mark_napi_id(struct sock *sk, struct sk_buff *skb)
+{
+	sk_extended(sk)->sk_napi_id = skb->napi_id;
+}
+
+#else /* CONFIG_NET_RX_BUSY_POLL */
+
+static inline bool net_busy_loop_on(void)
+{
+	return false;
+}
+
+static inline unsigned long busy_loop_us_clock(void)
+{
+	return 0;
+}
+
+static inline bool busy_loop_timeout(unsigned long start_time)
+{
+	return true;
+}
+
+static inline bool sk_can_busy_loop(struct sock *sk)
+{
+	return false;
+}
+
+static inline bool sk_busy_loop(struct sock *sk, int nonblock)
+{
+	return false;
+}
+
+static inline void skb_mark_napi_id(struct sk_buff *skb,
+				    unsigned int napi_id)
+{
+}
+
+static inline void sk_mark_napi_id(struct sock *sk, struct sk_buff *skb)
+{
+}
+
+#endif /* CONFIG_NET_RX_BUSY_POLL */
+#endif /* _LINUX_NET_BUSY_POLL_H */
@@ -48,6 +48,7 @@ struct dst_entry
 #define DST_NOXFRM		2
 #define DST_NOPOLICY		4
 #define DST_NOHASH		8
+#define DST_NOCACHE		0x0010
 #define DST_FAKE_RTABLE		0x0080
 	unsigned long		expires;
 
@@ -252,6 +253,8 @@ static inline struct dst_entry *dst_pop(struct dst_entry *dst)
 extern int dst_discard(struct sk_buff *skb);
 extern void * dst_alloc(struct dst_ops * ops);
 extern void __dst_free(struct dst_entry * dst);
+extern void dst_ifdown(struct dst_entry *dst, struct net_device *dev,
+		       int unregister);
 extern struct dst_entry *dst_destroy(struct dst_entry * dst);
 
 static inline void dst_free(struct dst_entry * dst)
@@ -262,12 +262,23 @@ static inline void inet_csk_reqsk_queue_add(struct sock *sk,
 extern void inet_csk_reqsk_queue_hash_add(struct sock *sk,
 					  struct request_sock *req,
 					  unsigned long timeout);
+extern int inet_csk_reqsk_queue_hash_add_unique(struct sock *sk,
+						struct request_sock *req,
+						unsigned long timeout);
 
 static inline void inet_csk_reqsk_queue_removed(struct sock *sk,
 						struct request_sock *req)
 {
-	if (reqsk_queue_removed(&inet_csk(sk)->icsk_accept_queue, req) == 0)
+	struct request_sock_queue *queue = &inet_csk(sk)->icsk_accept_queue;
+
+	if (reqsk_queue_removed(queue, req) == 0) {
 		inet_csk_delete_keepalive_timer(sk);
+		/* A SYN processed without the listener lock may have queued
+		 * a request and armed the timer we just deleted.
+		 */
+		if (unlikely(reqsk_queue_len(queue)))
+			inet_csk_reset_keepalive_timer(sk, inet_csk(sk)->icsk_rto);
+	}
 }
 
 static inline void inet_csk_reqsk_queue_added(struct sock *sk,
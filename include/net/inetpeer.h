@@ -27,6 +27,12 @@ struct inet_peer
 	atomic_t		rid;		/* Frag reception counter */
 	__u32			tcp_ts;
 	unsigned long		tcp_ts_stamp;
+#ifndef __GENKSYMS__
+	/* Learned by PMTU discovery and ICMP redirects, see route.c */
+	__u32			pmtu_learned;
+	unsigned long		pmtu_expires;
+	__be32			redirect_learned;
+#endif
 };
 
 void			inet_initpeers(void) __init;
@@ -60,6 +60,11 @@ struct fib_nh {
 #endif
 	int			nh_oif;
 	__be32			nh_gw;
+#ifndef __GENKSYMS__
+	/* Routes resolved through this nexthop, see route.c */
+	struct rt_nh_cache	*nh_rth_input;
+	struct rt_nh_cache	*nh_rth_output;
+#endif
 };
 
 /*
@@ -112,13 +112,24 @@ struct listen_sock {
  * changing rskq_accept_head. All readers that are holding the master sock lock
  * don't need to grab this lock in read mode too as rskq_accept_head. writes
  * are always protected from the main sock lock.
+ *
+ * Pure SYNs for a listener may also be processed without the master sock
+ * lock (see tcp_v4_rcv()). Such a path only ever pushes new requests at
+ * the head of a syn_table bucket and bumps qlen/qlen_young, so bucket
+ * heads and the counters are updated under %syn_wait_lock in write mode.
+ * Unlinking and freeing requests still requires the master sock lock.
  */
 struct request_sock_queue {
 	struct request_sock	*rskq_accept_head;
 	struct request_sock	*rskq_accept_tail;
 	rwlock_t		syn_wait_lock;
 	u8			rskq_defer_accept;
+#ifndef __GENKSYMS__
+	u8			rskq_lockless;	/* a SYN was handled unlocked */
+	/* 2 bytes hole, try to pack */
+#else
 	/* 3 bytes hole, try to pack */
+#endif
 	struct listen_sock	*listen_opt;
 };
 
@@ -147,6 +158,11 @@ static inline void reqsk_queue_unlink(struct request_sock_queue *queue,
 				      struct request_sock **prev_req)
 {
 	write_lock(&queue->syn_wait_lock);
+	/* A lockless SYN may have pushed new requests in front of @req
+	 * since @prev_req was looked up; walk forward to its real parent.
+	 */
+	while (*prev_req != req)
+		prev_req = &(*prev_req)->dl_next;
 	*prev_req = req->dl_next;
 	write_unlock(&queue->syn_wait_lock);
 }
@@ -198,20 +214,28 @@ static inline int reqsk_queue_removed(struct request_sock_queue *queue,
 				      struct request_sock *req)
 {
 	struct listen_sock *lopt = queue->listen_opt;
+	int qlen;
 
+	write_lock(&queue->syn_wait_lock);
 	if (req->retrans == 0)
 		--lopt->qlen_young;
+	qlen = --lopt->qlen;
+	write_unlock(&queue->syn_wait_lock);
 
-	return --lopt->qlen;
+	return qlen;
 }
 
 static inline int reqsk_queue_added(struct request_sock_queue *queue)
 {
 	struct listen_sock *lopt = queue->listen_opt;
-	const int prev_qlen = lopt->qlen;
+	int prev_qlen;
 
+	write_lock(&queue->syn_wait_lock);
+	prev_qlen = lopt->qlen;
 	lopt->qlen_young++;
 	lopt->qlen++;
+	write_unlock(&queue->syn_wait_lock);
+
 	return prev_qlen;
 }
 
@@ -230,9 +254,10 @@ static inline int reqsk_queue_is_full(const struct request_sock_queue *queue)
 	return queue->listen_opt->qlen >> queue->listen_opt->max_qlen_log;
 }
 
-static inline void reqsk_queue_hash_req(struct request_sock_queue *queue,
-					u32 hash, struct request_sock *req,
-					unsigned long timeout)
+/* Caller holds syn_wait_lock in write mode. */
+static inline void __reqsk_queue_hash_req(struct request_sock_queue *queue,
+					  u32 hash, struct request_sock *req,
+					  unsigned long timeout)
 {
 	struct listen_sock *lopt = queue->listen_opt;
 
@@ -240,9 +265,17 @@ static inline void reqsk_queue_hash_req(struct request_sock_queue *queue,
 	req->retrans = 0;
 	req->sk = NULL;
 	req->dl_next = lopt->syn_table[hash];
+	/* lockless readers of the bucket must see an initialized req */
+	smp_wmb();
+	lopt->syn_table[hash] = req;
+}
 
+static inline void reqsk_queue_hash_req(struct request_sock_queue *queue,
+					u32 hash, struct request_sock *req,
+					unsigned long timeout)
+{
 	write_lock(&queue->syn_wait_lock);
-	lopt->syn_table[hash] = req;
+	__reqsk_queue_hash_req(queue, hash, req, timeout);
 	write_unlock(&queue->syn_wait_lock);
 }
 
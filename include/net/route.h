@@ -75,6 +75,13 @@ struct rtable
 	/* Miscellaneous cached information */
 	__be32			rt_spec_dst; /* RFC1122 specific destination */
 	struct inet_peer	*peer; /* long-living peer info */
+#ifndef __GENKSYMS__
+	/* Routes still referencing a device, walked on unregister */
+	struct list_head	rt_dev_node;
+	struct rt_dev_list	*rt_dev_list;
+	/* rt_peer_genid() when what the peer learned was last applied */
+	u32			rt_peer_genid;
+#endif
 };
 
 struct ip_rt_acct
@@ -112,7 +119,7 @@ extern int		ip_rt_init(void);
 extern void		ip_rt_redirect(__be32 old_gw, __be32 dst, __be32 new_gw,
 				       __be32 src, struct net_device *dev);
 extern void		rt_cache_flush(struct net *net, int how);
-extern void		rt_cache_flush_batch(void);
+extern void		rt_flush_dev(struct net_device *dev);
 extern int		__ip_route_output_key(struct net *, struct rtable **, const struct flowi *flp);
 extern int		ip_route_output_key(struct net *, struct rtable **, struct flowi *flp);
 extern int		ip_route_output_flow(struct net *, struct rtable **rp, struct flowi *flp, struct sock *sk, int flags);
@@ -130,6 +137,9 @@ extern int		ip_rt_dump(struct sk_buff *skb,  struct netlink_callback *cb);
 struct in_ifaddr;
 extern void fib_add_ifaddr(struct in_ifaddr *);
 
+struct fib_nh;
+extern void rt_nh_flush(struct fib_nh *nh);
+
 static inline void ip_rt_put(struct rtable * rt)
 {
 	if (rt)
@@ -363,6 +363,12 @@ struct sock_extended {
 	const struct cred	*sk_peer_cred;
 	u16			sk_gso_max_segs;
 	u32			sk_pacing_rate; /* bytes per second */
+	struct sock_reuseport	*sk_reuseport_cb;
+	int			sk_incoming_cpu; /* SO_INCOMING_CPU, or -1 */
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	unsigned int		sk_napi_id;
+	unsigned int		sk_ll_usec;
+#endif
 };
 
 #define __sk_tx_queue_mapping(sk) \
@@ -1206,8 +1212,10 @@ extern void sock_init_data(struct socket *sock, struct sock *sk);
 
 static inline void sk_filter_release(struct sk_filter *fp)
 {
-	if (atomic_dec_and_test(&fp->refcnt))
+	if (atomic_dec_and_test(&fp->refcnt)) {
+		bpf_jit_free(fp);
 		kfree(fp);
+	}
 }
 
 static inline void sk_filter_uncharge(struct sock *sk, struct sk_filter *fp)
@@ -0,0 +1,29 @@
+#ifndef _SOCK_REUSEPORT_H
+#define _SOCK_REUSEPORT_H
+
+#include <linux/types.h>
+#include <linux/rcupdate.h>
+#include <net/sock.h>
+
+/*
+ * A group of SO_REUSEPORT sockets bound to the same address and port.
+ * The group hangs off every member (sk_extended(sk)->sk_reuseport_cb),
+ * so a lookup that hits any member can pick the final socket in O(1)
+ * instead of scoring the whole hash chain.
+ */
+struct sock_reuseport {
+	struct rcu_head		rcu;
+
+	u16			max_socks;	/* length of socks */
+	u16			num_socks;	/* elements in socks */
+	struct sock		*socks[0];	/* array of sock pointers,
+						 * followed by the CPU map */
+};
+
+extern int reuseport_alloc(struct sock *sk);
+extern int reuseport_add_sock(struct sock *sk, struct sock *sk2);
+extern void reuseport_detach_sock(struct sock *sk);
+extern struct sock *reuseport_select_sock(struct sock *sk, u32 hash);
+extern void reuseport_update_incoming_cpu(struct sock *sk);
+
+#endif  /* _SOCK_REUSEPORT_H */
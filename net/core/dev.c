@@ -123,9 +123,11 @@
 #include <linux/if_vlan.h>
 #include <linux/ip.h>
 #include <net/ip.h>
+#include <net/busy_poll.h>
 #include <linux/ipv6.h>
 #include <linux/in.h>
 #include <linux/jhash.h>
+#include <linux/hash.h>
 #include <linux/random.h>
 #include <linux/openvswitch.h>
 #ifndef __GENKSYMS__
@@ -2336,7 +2338,7 @@ gso:
 			return rc;
 		}
 		txq_trans_update(txq);
-		if (unlikely(netif_tx_queue_stopped(txq) && skb->next))
+		if (unlikely(netif_xmit_stopped(txq) && skb->next))
 			return NETDEV_TX_BUSY;
 	} while (skb->next);
 
@@ -2611,7 +2613,7 @@ int dev_queue_xmit(struct sk_buff *skb)
 
 			HARD_TX_LOCK(dev, txq, cpu);
 
-			if (!netif_tx_queue_stopped(txq)) {
+			if (!netif_xmit_stopped(txq)) {
 				rc = NET_XMIT_SUCCESS;
 				if (!dev_hard_start_xmit(skb, dev, txq)) {
 					HARD_TX_UNLOCK(dev, txq);
@@ -2714,6 +2716,75 @@ set_rps_cpu(struct net_device *dev, struct sk_buff *skb,
 	return rflow;
 }
 
+/*
+ * __skb_get_rxhash: calculate a flow hash based on src/dst addresses
+ * and src/dst port numbers of the packet whose network header starts
+ * at skb->data + nhoff. Sets skb->rxhash to a non-zero value on
+ * success, leaves it zero if the packet could not be parsed.
+ *
+ * The headers are read with skb_header_pointer(), so this is safe on
+ * shared skbs (e.g. from packet_type handlers).
+ */
+void __skb_get_rxhash(struct sk_buff *skb, int nhoff)
+{
+	const struct ipv6hdr *ip6;
+	const struct iphdr *ip;
+	struct ipv6hdr _ip6;
+	struct iphdr _ip;
+	const u32 *portp;
+	u32 _ports;
+	u8 ip_proto;
+	u32 addr1, addr2, ports, ihl;
+
+	switch (skb->protocol) {
+	case __constant_htons(ETH_P_IP):
+		ip = skb_header_pointer(skb, nhoff, sizeof(_ip), &_ip);
+		if (!ip)
+			return;
+
+		ip_proto = ip->protocol;
+		addr1 = (__force u32) ip->saddr;
+		addr2 = (__force u32) ip->daddr;
+		ihl = ip->ihl;
+		break;
+	case __constant_htons(ETH_P_IPV6):
+		ip6 = skb_header_pointer(skb, nhoff, sizeof(_ip6), &_ip6);
+		if (!ip6)
+			return;
+
+		ip_proto = ip6->nexthdr;
+		addr1 = (__force u32) ip6->saddr.s6_addr32[3];
+		addr2 = (__force u32) ip6->daddr.s6_addr32[3];
+		ihl = (40 >> 2);
+		break;
+	default:
+		return;
+	}
+	ports = 0;
+	switch (ip_proto) {
+	case IPPROTO_TCP:
+	case IPPROTO_UDP:
+	case IPPROTO_DCCP:
+	case IPPROTO_ESP:
+	case IPPROTO_AH:
+	case IPPROTO_SCTP:
+	case IPPROTO_UDPLITE:
+		portp = skb_header_pointer(skb, nhoff + (ihl * 4),
+					   sizeof(_ports), &_ports);
+		if (portp)
+			ports = *portp;
+		break;
+
+	default:
+		break;
+	}
+
+	skb->rxhash = jhash_3words(addr1, addr2, ports, hashrnd) >> 16;
+	if (!skb->rxhash)
+		skb->rxhash = 1;
+}
+EXPORT_SYMBOL(__skb_get_rxhash);
+
 /*
  * get_rps_cpu is called from netif_receive_skb and returns the target
  * CPU from the RPS map of the receiving queue for a given skb.
@@ -2721,8 +2792,6 @@ set_rps_cpu(struct net_device *dev, struct sk_buff *skb,
 static int get_rps_cpu(struct net_device *dev, struct sk_buff *skb,
 		       struct rps_dev_flow **rflowp)
 {
-	struct ipv6hdr *ip6;
-	struct iphdr *ip;
 	struct netdev_rx_queue *rxqueue;
 	struct rps_map *map;
 	struct rps_dev_flow_table *flow_table;
@@ -2730,8 +2799,6 @@ static int get_rps_cpu(struct net_device *dev, struct sk_buff *skb,
 	struct netdev_rps_info *rpinfo = &netdev_extended(dev)->rps_data;
 	int cpu = -1;
 	int tcpu;
-	u8 ip_proto;
-	u32 addr1, addr2, ports, ihl;
 
 	rcu_read_lock();
 
@@ -2754,50 +2821,10 @@ static int get_rps_cpu(struct net_device *dev, struct sk_buff *skb,
 	if (skb->rxhash)
 		goto got_hash; /* Skip hash computation on packet header */
 
-	switch (skb->protocol) {
-	case __constant_htons(ETH_P_IP):
-		if (!pskb_may_pull(skb, sizeof(*ip)))
-			goto done;
-
-		ip = (struct iphdr *) skb->data;
-		ip_proto = ip->protocol;
-		addr1 = ip->saddr;
-		addr2 = ip->daddr;
-		ihl = ip->ihl;
-		break;
-	case __constant_htons(ETH_P_IPV6):
-		if (!pskb_may_pull(skb, sizeof(*ip6)))
-			goto done;
-
-		ip6 = (struct ipv6hdr *) skb->data;
-		ip_proto = ip6->nexthdr;
-		addr1 = ip6->saddr.s6_addr32[3];
-		addr2 = ip6->daddr.s6_addr32[3];
-		ihl = (40 >> 2);
-		break;
-	default:
-		goto done;
-	}
-	ports = 0;
-	switch (ip_proto) {
-	case IPPROTO_TCP:
-	case IPPROTO_UDP:
-	case IPPROTO_DCCP:
-	case IPPROTO_ESP:
-	case IPPROTO_AH:
-	case IPPROTO_SCTP:
-	case IPPROTO_UDPLITE:
-		if (pskb_may_pull(skb, (ihl * 4) + 4))
-			ports = *((u32 *) (skb->data + (ihl * 4)));
-		break;
-
-	default:
-		break;
-	}
-
-	skb->rxhash = jhash_3words(addr1, addr2, ports, hashrnd) >> 16;
+	/* skb->data points at the network header here */
+	__skb_get_rxhash(skb, 0);
 	if (!skb->rxhash)
-		skb->rxhash = 1;
+		goto done;
 
 got_hash:
 	flow_table = rcu_dereference(rxqueue->rps_flow_table);
@@ -3981,6 +4008,143 @@ void netif_napi_del(struct napi_struct *napi)
 }
 EXPORT_SYMBOL(netif_napi_del);
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+/*
+ * Busy polling: napi_hash maps a napi_id to its napi_struct.
+ *
+ * struct napi_struct is embedded in driver private data and cannot grow,
+ * so the hash nodes live in separately allocated entries and the id is
+ * handed back to the driver, which stamps it on every received skb.
+ */
+#define NAPI_HASH_BITS	8
+
+struct napi_hash_entry {
+	struct hlist_node	node;
+	struct napi_struct	*napi;
+	unsigned int		napi_id;
+};
+
+static DEFINE_SPINLOCK(napi_hash_lock);
+static unsigned int napi_gen_id;
+static struct hlist_head napi_hash[1 << NAPI_HASH_BITS];
+
+static inline struct hlist_head *napi_hash_bucket(unsigned int napi_id)
+{
+	return &napi_hash[hash_32(napi_id, NAPI_HASH_BITS)];
+}
+
+/* must be called under rcu_read_lock(), as we dont take a reference */
+struct napi_struct *napi_by_id(unsigned int napi_id)
+{
+	struct napi_hash_entry *e;
+	struct hlist_node *pos;
+
+	hlist_for_each_entry_rcu(e, pos, napi_hash_bucket(napi_id), node)
+		if (e->napi_id == napi_id)
+			return e->napi;
+
+	return NULL;
+}
+EXPORT_SYMBOL_GPL(napi_by_id);
+
+unsigned int napi_hash_add(struct napi_struct *napi)
+{
+	struct napi_hash_entry *e;
+	unsigned int napi_id;
+
+	e = kmalloc(sizeof(*e), GFP_KERNEL);
+	if (!e)
+		return 0;
+
+	spin_lock(&napi_hash_lock);
+
+	/* 0 is not a valid id, we also skip an id that is taken
+	 * we expect both events to be extremely rare
+	 */
+	do {
+		if (unlikely(!++napi_gen_id))
+			napi_gen_id++;
+	} while (napi_by_id(napi_gen_id));
+	napi_id = napi_gen_id;
+
+	e->napi = napi;
+	e->napi_id = napi_id;
+	hlist_add_head_rcu(&e->node, napi_hash_bucket(napi_id));
+
+	spin_unlock(&napi_hash_lock);
+
+	return napi_id;
+}
+EXPORT_SYMBOL_GPL(napi_hash_add);
+
+void napi_hash_del(struct napi_struct *napi)
+{
+	struct napi_hash_entry *e, *found = NULL;
+	struct hlist_node *pos;
+	int i;
+
+	spin_lock(&napi_hash_lock);
+	for (i = 0; i < ARRAY_SIZE(napi_hash) && !found; i++) {
+		hlist_for_each_entry(e, pos, &napi_hash[i], node) {
+			if (e->napi == napi) {
+				hlist_del_rcu(&e->node);
+				found = e;
+				break;
+			}
+		}
+	}
+	spin_unlock(&napi_hash_lock);
+
+	if (found) {
+		/* busy pollers may still be using @napi */
+		synchronize_net();
+		kfree(found);
+	}
+}
+EXPORT_SYMBOL_GPL(napi_hash_del);
+
+bool napi_busy_loop(unsigned int napi_id,
+		    bool (*loop_end)(void *, unsigned long),
+		    void *loop_end_arg)
+{
+	unsigned long start_time = loop_end ? busy_loop_us_clock() : 0;
+	int (*busy_poll)(struct napi_struct *napi);
+	struct napi_struct *napi;
+	int rc, work = 0;
+
+	rcu_read_lock();
+
+	napi = napi_by_id(napi_id);
+	if (!napi)
+		goto out;
+
+	busy_poll = netdev_extended(napi->dev)->ndo_busy_poll;
+	if (!busy_poll)
+		goto out;
+
+	for (;;) {
+		local_bh_disable();
+		rc = busy_poll(napi);
+		if (rc > 0) {
+			work += rc;
+			NET_ADD_STATS_BH(dev_net(napi->dev),
+					 LINUX_MIB_BUSYPOLLRXPACKETS, rc);
+		}
+		local_bh_enable();
+
+		if (rc == LL_FLUSH_FAILED || !loop_end ||
+		    loop_end(loop_end_arg, start_time) || need_resched())
+			break;
+
+		cpu_relax();
+	}
+out:
+	rcu_read_unlock();
+	return work > 0;
+}
+EXPORT_SYMBOL(napi_busy_loop);
+#endif /* CONFIG_NET_RX_BUSY_POLL */
+
 /*
  * net_rps_action sends any pending IPI's for rps.  This is only called from
  * softirq and interrupts must be enabled.
@@ -6555,8 +6719,12 @@ struct net_device *alloc_netdev_mqs(int sizeof_priv, const char *name,
 		       "extensions for tx qdiscs.\n");
 		goto free_tx;
 	}
-	for (i = 0; i < txqs; i++)
+	for (i = 0; i < txqs; i++) {
 		tx_ext[i].q = &tx[i];
+#ifdef CONFIG_BQL
+		dql_init(&tx_ext[i].dql, HZ);
+#endif
+	}
 
 	dev_ext_frozen = PTR_ALIGN(p, NETDEV_ALIGN);
 	dev = netdev_extended_frozen_get_dev(dev_ext_frozen);
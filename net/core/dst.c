@@ -262,6 +262,15 @@ again:
 	return NULL;
 }
 
+static void dst_destroy_rcu(struct rcu_head *head)
+{
+	struct dst_entry *dst = container_of(head, struct dst_entry, rcu_head);
+
+	dst = dst_destroy(dst);
+	if (dst)
+		__dst_free(dst);
+}
+
 void dst_release(struct dst_entry *dst)
 {
 	if (dst) {
@@ -270,6 +279,12 @@ void dst_release(struct dst_entry *dst)
 		smp_mb__before_atomic_dec();
                newrefcnt = atomic_dec_return(&dst->__refcnt);
                WARN_ON(newrefcnt < 0);
+		/* Entries that never sit in a cache are not seen by the
+		 * garbage collector, the last user destroys them. Not
+		 * right here: we may be called with IRQs disabled.
+		 */
+		if (unlikely(dst->flags & DST_NOCACHE) && !newrefcnt)
+			call_rcu_bh(&dst->rcu_head, dst_destroy_rcu);
 	}
 }
 EXPORT_SYMBOL(dst_release);
@@ -282,8 +297,8 @@ EXPORT_SYMBOL(dst_release);
  *
  * Commented and originally written by Alexey.
  */
-static inline void dst_ifdown(struct dst_entry *dst, struct net_device *dev,
-			      int unregister)
+void dst_ifdown(struct dst_entry *dst, struct net_device *dev,
+		int unregister)
 {
 	if (dst->ops->ifdown)
 		dst->ops->ifdown(dst, dev, unregister);
@@ -64,6 +64,7 @@ int reqsk_queue_alloc(struct request_sock_queue *queue,
 	lopt->nr_table_entries = nr_table_entries;
 
 	write_lock_bh(&queue->syn_wait_lock);
+	queue->rskq_lockless = 0;
 	queue->listen_opt = lopt;
 	write_unlock_bh(&queue->syn_wait_lock);
 
@@ -128,6 +128,8 @@
 #include <linux/ipsec.h>
 #include <net/cls_cgroup.h>
 #include <net/netprio_cgroup.h>
+#include <net/sock_reuseport.h>
+#include <net/busy_poll.h>
 
 #include <linux/filter.h>
 
@@ -226,6 +228,11 @@ __u32 sysctl_rmem_default __read_mostly = SK_RMEM_MAX;
 int sysctl_optmem_max __read_mostly = sizeof(unsigned long)*(2*UIO_MAXIOV+512);
 EXPORT_SYMBOL(sysctl_optmem_max);
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+unsigned int sysctl_net_busy_read __read_mostly;
+unsigned int sysctl_net_busy_poll __read_mostly;
+#endif
+
 #if defined(CONFIG_CGROUPS)
 #if !defined(CONFIG_NET_CLS_CGROUP)
 int net_cls_subsys_id = -1;
@@ -742,6 +749,34 @@ set_rcvbuf:
 		else
 			sock_reset_flag(sk, SOCK_RXQ_OVFL);
 		break;
+	case SO_INCOMING_CPU:
+		/* Unlike upstream this is not refreshed on receive: it
+		 * names the CPU whose packets the reuseport group should
+		 * steer to this socket, -1 for none.
+		 */
+		if (val < -1 || val >= (int)nr_cpu_ids ||
+		    (val >= 0 && !cpu_possible(val))) {
+			ret = -EINVAL;
+			break;
+		}
+		sk_extended(sk)->sk_incoming_cpu = val;
+		reuseport_update_incoming_cpu(sk);
+		break;
+
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	case SO_BUSY_POLL:
+		/* allow unprivileged users to decrease the value */
+		if ((val > sk_extended(sk)->sk_ll_usec) &&
+		    !capable(CAP_NET_ADMIN))
+			ret = -EPERM;
+		else {
+			if (val < 0)
+				ret = -EINVAL;
+			else
+				sk_extended(sk)->sk_ll_usec = val;
+		}
+		break;
+#endif
 	default:
 		ret = -ENOPROTOOPT;
 		break;
@@ -967,6 +1002,16 @@ int sock_getsockopt(struct socket *sock, int level, int optname,
 		v.val = !!sock_flag(sk, SOCK_RXQ_OVFL);
 		break;
 
+	case SO_INCOMING_CPU:
+		v.val = sk_extended(sk)->sk_incoming_cpu;
+		break;
+
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	case SO_BUSY_POLL:
+		v.val = sk_extended(sk)->sk_ll_usec;
+		break;
+#endif
+
 	default:
 		return -ENOPROTOOPT;
 	}
@@ -1218,6 +1263,7 @@ struct sock *sk_clone(const struct sock *sk, const gfp_t priority)
 		bh_lock_sock(newsk);
 		newsk->sk_backlog.head	= newsk->sk_backlog.tail = NULL;
 		sk_extended(newsk)->sk_backlog.len = 0;
+		sk_extended(newsk)->sk_reuseport_cb = NULL;
 
 		atomic_set(&newsk->sk_rmem_alloc, 0);
 		/*
@@ -1982,6 +2028,11 @@ void sock_init_data(struct socket *sock, struct sock *sk)
 
 	sk_extended(sk)->sk_peer_pid 	=	NULL;
 	sk_extended(sk)->sk_peer_cred	=	NULL;
+	sk_extended(sk)->sk_incoming_cpu =	-1;
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	sk_extended(sk)->sk_napi_id	=	0;
+	sk_extended(sk)->sk_ll_usec	=	sysctl_net_busy_read;
+#endif
 	sk->sk_write_pending	=	0;
 	sk->sk_rcvlowat		=	1;
 	sk->sk_rcvtimeo		=	MAX_SCHEDULE_TIMEOUT;
@@ -2192,6 +2243,17 @@ void sk_common_release(struct sock *sk)
 }
 EXPORT_SYMBOL(sk_common_release);
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+bool sk_busy_loop_end(void *p, unsigned long start_time)
+{
+	struct sock *sk = p;
+
+	return !skb_queue_empty(&sk->sk_receive_queue) ||
+	       sk_busy_loop_timeout(sk, start_time);
+}
+EXPORT_SYMBOL(sk_busy_loop_end);
+#endif
+
 static DEFINE_RWLOCK(proto_list_lock);
 static LIST_HEAD(proto_list);
 
@@ -0,0 +1,250 @@
+/*
+ * To speed up listener socket lookup, create an array to store all sockets
+ * listening on the same port. This allows a decision to be made after finding
+ * the first socket. Each group also carries a CPU map so that a socket which
+ * asked for it with SO_INCOMING_CPU is preferred for packets received on
+ * that CPU.
+ */
+
+#include <net/sock_reuseport.h>
+#include <linux/slab.h>
+#include <linux/cpumask.h>
+
+#define INIT_SOCKS 128
+#define REUSEPORT_NO_SOCK USHRT_MAX
+
+static DEFINE_SPINLOCK(reuseport_lock);
+
+/* The CPU map lives right behind socks[] in the same allocation. */
+static inline u16 *reuseport_cpu_map(struct sock_reuseport *reuse)
+{
+	return (u16 *)&reuse->socks[reuse->max_socks];
+}
+
+static struct sock_reuseport *__reuseport_alloc(unsigned int max_socks)
+{
+	unsigned int size = sizeof(struct sock_reuseport) +
+			    sizeof(struct sock *) * max_socks +
+			    sizeof(u16) * nr_cpu_ids;
+	struct sock_reuseport *reuse = kzalloc(size, GFP_ATOMIC);
+	int cpu;
+
+	if (!reuse)
+		return NULL;
+
+	reuse->max_socks = max_socks;
+	for (cpu = 0; cpu < nr_cpu_ids; cpu++)
+		reuseport_cpu_map(reuse)[cpu] = REUSEPORT_NO_SOCK;
+
+	return reuse;
+}
+
+/*
+ * Rebuild the CPU map from the members' sk_incoming_cpu. Concurrent
+ * readers may briefly miss an entry and fall back to hashing, which
+ * is harmless. Caller holds reuseport_lock.
+ */
+static void reuseport_update_cpu_map(struct sock_reuseport *reuse)
+{
+	u16 *map = reuseport_cpu_map(reuse);
+	int i, cpu;
+
+	for (cpu = 0; cpu < nr_cpu_ids; cpu++)
+		map[cpu] = REUSEPORT_NO_SOCK;
+
+	/* walk backwards so the first socket pinned to a CPU wins */
+	for (i = reuse->num_socks - 1; i >= 0; i--) {
+		cpu = sk_extended(reuse->socks[i])->sk_incoming_cpu;
+		if (cpu >= 0 && cpu < nr_cpu_ids)
+			map[cpu] = i;
+	}
+}
+
+int reuseport_alloc(struct sock *sk)
+{
+	struct sock_reuseport *reuse;
+
+	/* bh lock used since this function call may precede hlist lock in
+	 * soft irq of receive path or setsockopt from process context
+	 */
+	spin_lock_bh(&reuseport_lock);
+	WARN_ONCE(sk_extended(sk)->sk_reuseport_cb,
+		  "multiple allocations for the same socket");
+	reuse = __reuseport_alloc(INIT_SOCKS);
+	if (!reuse) {
+		spin_unlock_bh(&reuseport_lock);
+		return -ENOMEM;
+	}
+
+	reuse->socks[0] = sk;
+	reuse->num_socks = 1;
+	reuseport_update_cpu_map(reuse);
+	rcu_assign_pointer(sk_extended(sk)->sk_reuseport_cb, reuse);
+
+	spin_unlock_bh(&reuseport_lock);
+
+	return 0;
+}
+EXPORT_SYMBOL(reuseport_alloc);
+
+static void reuseport_free_rcu(struct rcu_head *head)
+{
+	struct sock_reuseport *reuse;
+
+	reuse = container_of(head, struct sock_reuseport, rcu);
+	kfree(reuse);
+}
+
+static struct sock_reuseport *reuseport_grow(struct sock_reuseport *reuse)
+{
+	struct sock_reuseport *more_reuse;
+	u32 more_socks_size, i;
+
+	more_socks_size = reuse->max_socks * 2U;
+	if (more_socks_size > REUSEPORT_NO_SOCK)
+		more_socks_size = REUSEPORT_NO_SOCK;
+	if (more_socks_size == reuse->max_socks)
+		return NULL;
+
+	more_reuse = __reuseport_alloc(more_socks_size);
+	if (!more_reuse)
+		return NULL;
+
+	more_reuse->num_socks = reuse->num_socks;
+	memcpy(more_reuse->socks, reuse->socks,
+	       reuse->num_socks * sizeof(struct sock *));
+	memcpy(reuseport_cpu_map(more_reuse), reuseport_cpu_map(reuse),
+	       nr_cpu_ids * sizeof(u16));
+
+	for (i = 0; i < reuse->num_socks; ++i)
+		rcu_assign_pointer(sk_extended(reuse->socks[i])->sk_reuseport_cb,
+				   more_reuse);
+
+	/* Note: we use call_rcu() instead of kfree() because concurrent
+	 * readers may still be walking the old socks array.
+	 */
+	call_rcu(&reuse->rcu, reuseport_free_rcu);
+	return more_reuse;
+}
+
+/**
+ *  reuseport_add_sock - Add a socket to the reuseport group of another.
+ *  @sk:  New socket to add to the group.
+ *  @sk2: Socket belonging to the existing reuseport group.
+ *  May return ENOMEM and not add socket to group under memory pressure.
+ */
+int reuseport_add_sock(struct sock *sk, struct sock *sk2)
+{
+	struct sock_reuseport *reuse;
+
+	if (!sk_extended(sk2)->sk_reuseport_cb) {
+		int err = reuseport_alloc(sk2);
+
+		if (err)
+			return err;
+	}
+
+	spin_lock_bh(&reuseport_lock);
+	reuse = sk_extended(sk2)->sk_reuseport_cb;
+	WARN_ONCE(sk_extended(sk)->sk_reuseport_cb,
+		  "socket already in reuseport group");
+
+	if (reuse->num_socks == reuse->max_socks) {
+		reuse = reuseport_grow(reuse);
+		if (!reuse) {
+			spin_unlock_bh(&reuseport_lock);
+			return -ENOMEM;
+		}
+	}
+
+	reuse->socks[reuse->num_socks] = sk;
+	/* paired with smp_rmb() in reuseport_select_sock() */
+	smp_wmb();
+	reuse->num_socks++;
+	rcu_assign_pointer(sk_extended(sk)->sk_reuseport_cb, reuse);
+	reuseport_update_cpu_map(reuse);
+
+	spin_unlock_bh(&reuseport_lock);
+
+	return 0;
+}
+EXPORT_SYMBOL(reuseport_add_sock);
+
+void reuseport_detach_sock(struct sock *sk)
+{
+	struct sock_reuseport *reuse;
+	int i;
+
+	spin_lock_bh(&reuseport_lock);
+	reuse = sk_extended(sk)->sk_reuseport_cb;
+	if (!reuse) {
+		spin_unlock_bh(&reuseport_lock);
+		return;
+	}
+	rcu_assign_pointer(sk_extended(sk)->sk_reuseport_cb, NULL);
+
+	for (i = 0; i < reuse->num_socks; i++) {
+		if (reuse->socks[i] == sk) {
+			reuse->socks[i] = reuse->socks[reuse->num_socks - 1];
+			reuse->num_socks--;
+			if (reuse->num_socks == 0)
+				call_rcu(&reuse->rcu, reuseport_free_rcu);
+			else
+				reuseport_update_cpu_map(reuse);
+			break;
+		}
+	}
+	spin_unlock_bh(&reuseport_lock);
+}
+EXPORT_SYMBOL(reuseport_detach_sock);
+
+/**
+ *  reuseport_update_incoming_cpu - refresh the CPU map after SO_INCOMING_CPU
+ *  @sk: socket whose sk_incoming_cpu changed
+ */
+void reuseport_update_incoming_cpu(struct sock *sk)
+{
+	struct sock_reuseport *reuse;
+
+	spin_lock_bh(&reuseport_lock);
+	reuse = sk_extended(sk)->sk_reuseport_cb;
+	if (reuse)
+		reuseport_update_cpu_map(reuse);
+	spin_unlock_bh(&reuseport_lock);
+}
+
+/**
+ *  reuseport_select_sock - Select a socket from an SO_REUSEPORT group.
+ *  @sk: First socket in the group.
+ *  @hash: When no socket is pinned to the receiving CPU, use this hash
+ *         to select.
+ *  Returns a socket that should receive the packet (or NULL on error).
+ *  The caller must hold rcu_read_lock() and is responsible for taking
+ *  a reference on the returned socket.
+ */
+struct sock *reuseport_select_sock(struct sock *sk, u32 hash)
+{
+	struct sock_reuseport *reuse;
+	struct sock *sk2 = NULL;
+	u16 socks, idx;
+
+	reuse = rcu_dereference(sk_extended(sk)->sk_reuseport_cb);
+
+	/* if memory allocation failed or add call is not yet complete */
+	if (!reuse)
+		return NULL;
+
+	socks = ACCESS_ONCE(reuse->num_socks);
+	if (likely(socks)) {
+		/* paired with smp_wmb() in reuseport_add_sock() */
+		smp_rmb();
+
+		idx = ACCESS_ONCE(reuseport_cpu_map(reuse)[raw_smp_processor_id()]);
+		if (idx >= socks)
+			idx = ((u64)hash * socks) >> 32;
+		sk2 = reuse->socks[idx];
+	}
+
+	return sk2;
+}
+EXPORT_SYMBOL(reuseport_select_sock);
@@ -502,6 +502,39 @@ extern int sysctl_tcp_synack_retries;
 
 EXPORT_SYMBOL_GPL(inet_csk_reqsk_queue_hash_add);
 
+/*
+ * Like inet_csk_reqsk_queue_hash_add(), but refuses to queue @req if a
+ * request for the same 4-tuple is already there. SYNs processed without
+ * the listener lock can race with a copy of themselves on another CPU.
+ * Returns 1 if @req was queued.
+ */
+int inet_csk_reqsk_queue_hash_add_unique(struct sock *sk,
+					 struct request_sock *req,
+					 unsigned long timeout)
+{
+	struct inet_connection_sock *icsk = inet_csk(sk);
+	struct request_sock_queue *queue = &icsk->icsk_accept_queue;
+	const struct inet_request_sock *ireq = inet_rsk(req);
+	const u32 h = inet_synq_hash(ireq->rmt_addr, ireq->rmt_port,
+				     queue->listen_opt->hash_rnd,
+				     queue->listen_opt->nr_table_entries);
+	struct request_sock **prev;
+
+	write_lock(&queue->syn_wait_lock);
+	if (inet_csk_search_req(sk, &prev, ireq->rmt_port, ireq->rmt_addr,
+				ireq->loc_addr)) {
+		write_unlock(&queue->syn_wait_lock);
+		return 0;
+	}
+	__reqsk_queue_hash_req(queue, h, req, timeout);
+	write_unlock(&queue->syn_wait_lock);
+
+	inet_csk_reqsk_queue_added(sk, timeout);
+	return 1;
+}
+
+EXPORT_SYMBOL_GPL(inet_csk_reqsk_queue_hash_add_unique);
+
 /* Decide when to expire the request and when to resend SYN-ACK */
 static inline void syn_ack_recalc(struct request_sock *req, const int thresh,
 				  const int max_retries,
@@ -590,8 +623,11 @@ void inet_csk_reqsk_queue_prune(struct sock *parent,
 				     inet_rsk(req)->acked)) {
 					unsigned long timeo;
 
-					if (req->retrans++ == 0)
+					if (req->retrans++ == 0) {
+						write_lock(&queue->syn_wait_lock);
 						lopt->qlen_young--;
+						write_unlock(&queue->syn_wait_lock);
+					}
 					timeo = min((timeout << req->retrans), max_rto);
 					req->expires = now + timeo;
 					reqp = &req->dl_next;
@@ -725,6 +761,15 @@ void inet_csk_listen_stop(struct sock *sk)
 	struct request_sock *acc_req;
 	struct request_sock *req;
 
+	/* The caller already moved us out of TCP_LISTEN. If SYNs were
+	 * handled without the socket lock, wait for those still in flight
+	 * before tearing down listen_opt under them. Listeners that never
+	 * took that path close without waiting for a grace period.
+	 */
+	smp_mb();
+	if (icsk->icsk_accept_queue.rskq_lockless)
+		synchronize_net();
+
 	inet_csk_delete_keepalive_timer(sk);
 
 	/* make all the listen_opt local to us */
@@ -23,6 +23,7 @@
 #include <net/inet_hashtables.h>
 #include <net/secure_seq.h>
 #include <net/ip.h>
+#include <net/sock_reuseport.h>
 
 /*
  * Allocate and initialize a new local port bind bucket.
@@ -184,16 +185,20 @@ struct sock *__inet_lookup_listener(struct net *net,
 				    const __be32 daddr, const unsigned short hnum,
 				    const int dif)
 {
-	struct sock *sk, *result;
+	struct sock *sk, *result, *group;
 	struct hlist_nulls_node *node;
 	unsigned int hash = inet_lhashfn(net, hnum);
 	struct inet_listen_hashbucket *ilb = &hashinfo->listening_hash[hash];
 	int score, hiscore, matches = 0, reuseport = 0;
+	/* best score compute_score() can give for this key */
+	int maxscore = 2 + 4 + (dif ? 4 : 0);
+	bool use_group = true;
 	u32 phash = 0;
 
 	rcu_read_lock();
 begin:
 	result = NULL;
+	group = NULL;
 	hiscore = 0;
 	sk_nulls_for_each_rcu(sk, node, &ilb->head) {
 		score = compute_score(sk, net, hnum, daddr, dif);
@@ -201,9 +206,16 @@ begin:
 			result = sk;
 			hiscore = score;
 			reuseport = sk->sk_reuseport;
+			group = NULL;
 			if (reuseport) {
 				phash = inet_ehashfn(net, daddr, hnum,
 						     saddr, sport);
+				group = sk;
+				/* Nothing later on the chain can beat this
+				 * one, let its group pick right away.
+				 */
+				if (score == maxscore)
+					goto select;
 				matches = 1;
 			}
 		} else if (score == hiscore && reuseport) {
@@ -220,12 +232,20 @@ begin:
 	 */
 	if (get_nulls_value(node) != hash + LISTENING_NULLS_BASE)
 		goto begin;
+select:
+	/* All members of a group score alike, the best one picks. */
+	if (group && use_group) {
+		sk = reuseport_select_sock(group, phash);
+		if (sk)
+			result = sk;
+	}
 	if (result) {
 		if (unlikely(!atomic_inc_not_zero(&result->sk_refcnt)))
 			result = NULL;
 		else if (unlikely(compute_score(result, net, hnum, daddr,
 				  dif) < hiscore)) {
 			sock_put(result);
+			use_group = false;
 			goto begin;
 		}
 	}
@@ -409,6 +429,34 @@ void __inet_hash_nolisten(struct sock *sk)
 }
 EXPORT_SYMBOL_GPL(__inet_hash_nolisten);
 
+/*
+ * Attach a listener to the SO_REUSEPORT group of an identically bound
+ * listener in the same bucket, or start a new group. If the group cannot
+ * be allocated the socket is still hashed and __inet_lookup_listener()
+ * falls back to scoring the chain.
+ */
+static int inet_reuseport_add_sock(struct sock *sk,
+				   struct inet_listen_hashbucket *ilb)
+{
+	struct sock *sk2;
+	struct hlist_nulls_node *node;
+	uid_t uid = sock_i_uid(sk);
+
+	sk_nulls_for_each(sk2, node, &ilb->head) {
+		if (sk2 != sk &&
+		    sk2->sk_family == sk->sk_family &&
+		    ipv6_only_sock(sk2) == ipv6_only_sock(sk) &&
+		    sk2->sk_bound_dev_if == sk->sk_bound_dev_if &&
+		    inet_sk(sk2)->num == inet_sk(sk)->num &&
+		    inet_sk(sk2)->rcv_saddr == inet_sk(sk)->rcv_saddr &&
+		    net_eq(sock_net(sk2), sock_net(sk)) &&
+		    sk2->sk_reuseport && uid == sock_i_uid(sk2))
+			return reuseport_add_sock(sk, sk2);
+	}
+
+	return reuseport_alloc(sk);
+}
+
 static void __inet_hash(struct sock *sk)
 {
 	struct inet_hashinfo *hashinfo = sk->sk_prot->h.hashinfo;
@@ -423,6 +471,8 @@ static void __inet_hash(struct sock *sk)
 	ilb = &hashinfo->listening_hash[inet_sk_listen_hashfn(sk)];
 
 	spin_lock(&ilb->lock);
+	if (sk->sk_reuseport)
+		inet_reuseport_add_sock(sk, ilb);
 	__sk_nulls_add_node_rcu(sk, &ilb->head);
 	sock_prot_inuse_add(sock_net(sk), sk->sk_prot, 1);
 	spin_unlock(&ilb->lock);
@@ -453,6 +503,8 @@ void inet_unhash(struct sock *sk)
 		lock = inet_ehash_lockp(hashinfo, sk->sk_hash);
 
 	spin_lock_bh(lock);
+	if (sk_extended(sk)->sk_reuseport_cb)
+		reuseport_detach_sock(sk);
 	done =__sk_nulls_del_node_init_rcu(sk);
 	if (done)
 		sock_prot_inuse_add(sock_net(sk), sk->sk_prot, -1);
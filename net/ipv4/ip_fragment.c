@@ -623,6 +623,50 @@ int ip_defrag(struct sk_buff *skb, u32 user)
 	return -ENOMEM;
 }
 
+/*
+ * Reassemble @skb if it is an IPv4 fragment received on a shared path
+ * (e.g. a packet socket fanout group). Returns the skb to keep using,
+ * or NULL if it was queued for reassembly or dropped.
+ */
+struct sk_buff *ip_check_defrag(struct sk_buff *skb, u32 user)
+{
+	struct iphdr iph;
+	u32 len;
+
+	if (skb->protocol != htons(ETH_P_IP))
+		return skb;
+
+	/* Only frames whose data starts at the IP header (received ones) */
+	if (skb_network_offset(skb))
+		return skb;
+
+	if (skb_copy_bits(skb, 0, &iph, sizeof(iph)) < 0)
+		return skb;
+
+	if (iph.ihl < 5 || iph.version != 4)
+		return skb;
+
+	len = ntohs(iph.tot_len);
+	if (skb->len < len || len < (iph.ihl * 4))
+		return skb;
+
+	if (iph.frag_off & htons(IP_MF | IP_OFFSET)) {
+		skb = skb_share_check(skb, GFP_ATOMIC);
+		if (skb) {
+			if (!pskb_may_pull(skb, iph.ihl * 4))
+				return skb;
+			if (pskb_trim_rcsum(skb, len))
+				return skb;
+			memset(IPCB(skb), 0, sizeof(struct inet_skb_parm));
+			if (ip_defrag(skb, user))
+				return NULL;
+			skb->rxhash = 0;
+		}
+	}
+	return skb;
+}
+EXPORT_SYMBOL(ip_check_defrag);
+
 #ifdef CONFIG_SYSCTL
 static int zero;
 
@@ -90,6 +90,7 @@
 #include <linux/jhash.h>
 #include <linux/rcupdate.h>
 #include <linux/times.h>
+#include <linux/log2.h>
 #include <net/dst.h>
 #include <net/net_namespace.h>
 #include <net/protocol.h>
@@ -116,24 +117,28 @@
 
 #define RT_GC_TIMEOUT (300*HZ)
 
-static int ip_rt_max_size;
-static int ip_rt_gc_timeout __read_mostly	= RT_GC_TIMEOUT;
-static int ip_rt_gc_interval __read_mostly	= 60 * HZ;
-static int ip_rt_gc_min_interval __read_mostly	= HZ / 2;
 static int ip_rt_redirect_number __read_mostly	= 9;
 static int ip_rt_redirect_load __read_mostly	= HZ / 50;
 static int ip_rt_redirect_silence __read_mostly	= ((HZ / 50) << (9 + 1));
 static int ip_rt_error_cost __read_mostly	= HZ;
 static int ip_rt_error_burst __read_mostly	= 5 * HZ;
-static int ip_rt_gc_elasticity __read_mostly	= 8;
 static int ip_rt_mtu_expires __read_mostly	= 10 * 60 * HZ;
 static int ip_rt_min_pmtu __read_mostly		= 512 + 20 + 20;
 static int ip_rt_min_advmss __read_mostly	= 256;
-static int ip_rt_secret_interval __read_mostly	= 10 * 60 * HZ;
-static int rt_chain_length_max __read_mostly	= 20;
 
-static struct delayed_work expires_work;
-static unsigned long expires_ljiffies;
+/* Bounds the slots of all grown nexthop tables together, see
+ * rt_nh_cache_alloc().
+ */
+static int ip_rt_max_size;
+
+/* These tuned the route cache, which is gone. They are kept so that
+ * existing sysctl settings still apply cleanly, but have no effect.
+ */
+static int ip_rt_gc_timeout __read_mostly	= RT_GC_TIMEOUT;
+static int ip_rt_gc_interval __read_mostly	= 60 * HZ;
+static int ip_rt_gc_min_interval __read_mostly	= HZ / 2;
+static int ip_rt_gc_elasticity __read_mostly	= 8;
+static int ip_rt_secret_interval __read_mostly	= 10 * 60 * HZ;
 
 /*
  *	Interface to generic destination cache.
@@ -146,14 +151,11 @@ static void		 ipv4_dst_ifdown(struct dst_entry *dst,
 static struct dst_entry *ipv4_negative_advice(struct dst_entry *dst);
 static void		 ipv4_link_failure(struct sk_buff *skb);
 static void		 ip_rt_update_pmtu(struct dst_entry *dst, u32 mtu);
-static int rt_garbage_collect(struct dst_ops *ops);
-static void rt_emergency_hash_rebuild(struct net *net);
 
 
 static struct dst_ops ipv4_dst_ops = {
 	.family =		AF_INET,
 	.protocol =		cpu_to_be16(ETH_P_IP),
-	.gc =			rt_garbage_collect,
 	.check =		ipv4_dst_check,
 	.destroy =		ipv4_dst_destroy,
 	.ifdown =		ipv4_dst_ifdown,
@@ -187,185 +189,118 @@ const __u8 ip_tos2prio[16] = {
 EXPORT_SYMBOL(ip_tos2prio);
 
 /*
- * Route cache.
- */
-
-/* The locking scheme is rather straight forward:
+ * Route caching.
+ *
+ * There is no global route cache. Every lookup walks the FIB, and the
+ * routes it builds are remembered in a table hanging off the nexthop
+ * they were resolved through, one for input and one for output routes.
+ * A slot holds the last route hashed to it and nothing needs to be
+ * garbage collected: a route is destroyed when its last user, the slot
+ * included, releases it.
  *
- * 1) Read-Copy Update protects the buckets of the central route hash.
- * 2) Only writers remove entries, and they hold the lock
- *    as they look at rtable reference counts.
- * 3) Only readers acquire references to rtable entries,
- *    they do so with atomic increments and with the
- *    lock held.
+ * Tables start small and grow when live routes keep evicting each
+ * other, up to rt_nh_cache_max slots, so that a gateway leading to
+ * many destinations does not turn every lookup into a miss. Grown
+ * tables together hold at most ip_rt_max_size slots, and so at most
+ * that many routes.
+ *
+ * 1) Readers look at a slot under rcu_read_lock_bh() and take a
+ *    reference before leaving the critical section, unless the route
+ *    already lost its last one, see rt_nh_hold().
+ * 2) Writers xchg() routes in and out of slots and drop the slot's
+ *    reference with ip_rt_put(). The last put of a route defers its
+ *    destruction by a grace period, see dst_release().
+ * 3) A table replaced by a larger one is freed after a grace period.
+ *    The current tables only go away with their fib_info, when nobody
+ *    can be resolving through it any more.
  */
 
-struct rt_hash_bucket {
-	struct rtable	*chain;
+#define RT_NH_CACHE_MIN		64
+
+struct rt_nh_cache {
+	unsigned int		mask;
+	atomic_t		evictions;	/* since stamp */
+	unsigned long		stamp;
+	struct rcu_head		rcu;
+	struct rtable		*slot[0];
 };
 
-#if defined(CONFIG_SMP) || defined(CONFIG_DEBUG_SPINLOCK) || \
-	defined(CONFIG_PROVE_LOCKING)
+static unsigned int rt_nh_cache_max __read_mostly = RT_NH_CACHE_MIN;
+static atomic_t rt_nh_slots = ATOMIC_INIT(0);	/* in grown tables */
+static u32 rt_nh_rnd __read_mostly;
+
 /*
- * Instead of using one spinlock for each rt_hash_bucket, we use a table of spinlocks
- * The size of this table is a power of two and depends on the number of CPUS.
- * (on lockdep we have a quite big spinlock_t, so keep the size down there)
+ * Bumped whenever a peer learns a PMTU or a redirect, or forgets one.
+ * Routes built before that check whether it concerns them, see
+ * rt_peer_changed().
  */
-#ifdef CONFIG_LOCKDEP
-# define RT_HASH_LOCK_SZ	256
-#else
-# if NR_CPUS >= 32
-#  define RT_HASH_LOCK_SZ	4096
-# elif NR_CPUS >= 16
-#  define RT_HASH_LOCK_SZ	2048
-# elif NR_CPUS >= 8
-#  define RT_HASH_LOCK_SZ	1024
-# elif NR_CPUS >= 4
-#  define RT_HASH_LOCK_SZ	512
-# else
-#  define RT_HASH_LOCK_SZ	256
-# endif
-#endif
-
-static spinlock_t	*rt_hash_locks;
-# define rt_hash_lock_addr(slot) &rt_hash_locks[(slot) & (RT_HASH_LOCK_SZ - 1)]
+static atomic_t __rt_peer_genid = ATOMIC_INIT(0);
 
-static __init void rt_hash_lock_init(void)
+static inline u32 rt_peer_genid(void)
 {
-	int i;
-
-	rt_hash_locks = kmalloc(sizeof(spinlock_t) * RT_HASH_LOCK_SZ,
-			GFP_KERNEL);
-	if (!rt_hash_locks)
-		panic("IP: failed to allocate rt_hash_locks\n");
-
-	for (i = 0; i < RT_HASH_LOCK_SZ; i++)
-		spin_lock_init(&rt_hash_locks[i]);
+	return atomic_read(&__rt_peer_genid);
 }
-#else
-# define rt_hash_lock_addr(slot) NULL
 
-static inline void rt_hash_lock_init(void)
+static inline void rt_peer_genid_bump(void)
 {
+	/* peer fields before the genid, pairs with rt_peer_changed() */
+	smp_wmb();
+	atomic_inc(&__rt_peer_genid);
 }
-#endif
 
-static struct rt_hash_bucket 	*rt_hash_table __read_mostly;
-static unsigned			rt_hash_mask __read_mostly;
-static unsigned int		rt_hash_log  __read_mostly;
+/* Routes are not garbage collected, so those still alive when their
+ * device goes away have to be found. Each CPU keeps the routes it
+ * created on its own list.
+ */
+struct rt_dev_list {
+	spinlock_t		lock;
+	struct list_head	head;
+};
+
+static DEFINE_PER_CPU(struct rt_dev_list, rt_dev_list);
 
 static DEFINE_PER_CPU(struct rt_cache_stat, rt_cache_stat);
 #define RT_CACHE_STAT_INC(field) \
 	(__raw_get_cpu_var(rt_cache_stat).field++)
 
-static inline unsigned int rt_hash(__be32 daddr, __be32 saddr, int idx,
-		int genid)
+static inline unsigned int rt_nh_hash(__be32 daddr, __be32 saddr, int idx)
 {
 	return jhash_3words((__force u32)(__be32)(daddr),
 			    (__force u32)(__be32)(saddr),
-			    idx, genid)
-		& rt_hash_mask;
-}
-
-static inline int rt_genid(struct net *net)
-{
-	return atomic_read(&net->ipv4.rt_genid);
+			    idx, rt_nh_rnd);
 }
 
-#ifdef CONFIG_PROC_FS
-struct rt_cache_iter_state {
-	struct seq_net_private p;
-	int bucket;
-	int genid;
-};
-
-static struct rtable *rt_cache_get_first(struct seq_file *seq)
+/* The hash a route was stored under, input routes by iif, output by oif */
+static inline unsigned int rt_nh_key(const struct rtable *rt)
 {
-	struct rt_cache_iter_state *st = seq->private;
-	struct rtable *r = NULL;
-
-	for (st->bucket = rt_hash_mask; st->bucket >= 0; --st->bucket) {
-		if (!rt_hash_table[st->bucket].chain)
-			continue;
-		rcu_read_lock_bh();
-		r = rcu_dereference(rt_hash_table[st->bucket].chain);
-		while (r) {
-			if (dev_net(r->u.dst.dev) == seq_file_net(seq) &&
-			    r->rt_genid == st->genid)
-				return r;
-			r = rcu_dereference(r->u.dst.rt_next);
-		}
-		rcu_read_unlock_bh();
-	}
-	return r;
+	return rt_nh_hash(rt->fl.fl4_dst, rt->fl.fl4_src,
+			  rt->fl.iif ? rt->fl.iif : rt->fl.oif);
 }
 
-static struct rtable *__rt_cache_get_next(struct seq_file *seq,
-					  struct rtable *r)
-{
-	struct rt_cache_iter_state *st = seq->private;
-
-	r = r->u.dst.rt_next;
-	while (!r) {
-		rcu_read_unlock_bh();
-		do {
-			if (--st->bucket < 0)
-				return NULL;
-		} while (!rt_hash_table[st->bucket].chain);
-		rcu_read_lock_bh();
-		r = rt_hash_table[st->bucket].chain;
-	}
-	return rcu_dereference(r);
-}
-
-static struct rtable *rt_cache_get_next(struct seq_file *seq,
-					struct rtable *r)
-{
-	struct rt_cache_iter_state *st = seq->private;
-	while ((r = __rt_cache_get_next(seq, r)) != NULL) {
-		if (dev_net(r->u.dst.dev) != seq_file_net(seq))
-			continue;
-		if (r->rt_genid == st->genid)
-			break;
-	}
-	return r;
-}
-
-static struct rtable *rt_cache_get_idx(struct seq_file *seq, loff_t pos)
+static inline int rt_genid(struct net *net)
 {
-	struct rtable *r = rt_cache_get_first(seq);
-
-	if (r)
-		while (pos && (r = rt_cache_get_next(seq, r)))
-			--pos;
-	return pos ? NULL : r;
+	return atomic_read(&net->ipv4.rt_genid);
 }
 
+#ifdef CONFIG_PROC_FS
+/* There is no cache to dump any more, only the header is kept for the
+ * tools that parse this file.
+ */
 static void *rt_cache_seq_start(struct seq_file *seq, loff_t *pos)
 {
-	struct rt_cache_iter_state *st = seq->private;
 	if (*pos)
-		return rt_cache_get_idx(seq, *pos - 1);
-	st->genid = rt_genid(seq_file_net(seq));
+		return NULL;
 	return SEQ_START_TOKEN;
 }
 
 static void *rt_cache_seq_next(struct seq_file *seq, void *v, loff_t *pos)
 {
-	struct rtable *r;
-
-	if (v == SEQ_START_TOKEN)
-		r = rt_cache_get_first(seq);
-	else
-		r = rt_cache_get_next(seq, v);
 	++*pos;
-	return r;
+	return NULL;
 }
 
 static void rt_cache_seq_stop(struct seq_file *seq, void *v)
 {
-	if (v && v != SEQ_START_TOKEN)
-		rcu_read_unlock_bh();
 }
 
 static int rt_cache_seq_show(struct seq_file *seq, void *v)
@@ -375,29 +310,6 @@ static int rt_cache_seq_show(struct seq_file *seq, void *v)
 			   "Iface\tDestination\tGateway \tFlags\t\tRefCnt\tUse\t"
 			   "Metric\tSource\t\tMTU\tWindow\tIRTT\tTOS\tHHRef\t"
 			   "HHUptod\tSpecDst");
-	else {
-		struct rtable *r = v;
-		int len;
-
-		seq_printf(seq, "%s\t%08lX\t%08lX\t%8X\t%d\t%u\t%d\t"
-			      "%08lX\t%d\t%u\t%u\t%02X\t%d\t%1d\t%08X%n",
-			r->u.dst.dev ? r->u.dst.dev->name : "*",
-			(unsigned long)r->rt_dst, (unsigned long)r->rt_gateway,
-			r->rt_flags, atomic_read(&r->u.dst.__refcnt),
-			r->u.dst.__use, 0, (unsigned long)r->rt_src,
-			(dst_metric(&r->u.dst, RTAX_ADVMSS) ?
-			     (int)dst_metric(&r->u.dst, RTAX_ADVMSS) + 40 : 0),
-			dst_metric(&r->u.dst, RTAX_WINDOW),
-			(int)((dst_metric(&r->u.dst, RTAX_RTT) >> 3) +
-			      dst_metric(&r->u.dst, RTAX_RTTVAR)),
-			r->fl.fl4_tos,
-			r->u.dst.hh ? atomic_read(&r->u.dst.hh->hh_refcnt) : -1,
-			r->u.dst.hh ? (r->u.dst.hh->hh_output ==
-				       dev_queue_xmit) : 0,
-			r->rt_spec_dst, &len);
-
-		seq_printf(seq, "%*s\n", 127 - len, "");
-	}
 	return 0;
 }
 
@@ -410,8 +322,7 @@ static const struct seq_operations rt_cache_seq_ops = {
 
 static int rt_cache_seq_open(struct inode *inode, struct file *file)
 {
-	return seq_open_net(inode, file, &rt_cache_seq_ops,
-			sizeof(struct rt_cache_iter_state));
+	return seq_open(file, &rt_cache_seq_ops);
 }
 
 static const struct file_operations rt_cache_seq_fops = {
@@ -419,7 +330,7 @@ static const struct file_operations rt_cache_seq_fops = {
 	.open	 = rt_cache_seq_open,
 	.read	 = seq_read,
 	.llseek	 = seq_lseek,
-	.release = seq_release_net,
+	.release = seq_release,
 };
 
 
@@ -609,655 +520,390 @@ static inline int ip_rt_proc_init(void)
 }
 #endif /* CONFIG_PROC_FS */
 
-static inline void rt_free(struct rtable *rt)
-{
-	call_rcu_bh(&rt->u.dst.rcu_head, dst_rcu_free);
-}
-
-static inline void rt_drop(struct rtable *rt)
-{
-	ip_rt_put(rt);
-	call_rcu_bh(&rt->u.dst.rcu_head, dst_rcu_free);
-}
-
-static inline int rt_fast_clean(struct rtable *rth)
-{
-	/* Kill broadcast/multicast entries very aggresively, if they
-	   collide in hash table with more useful entries */
-	return (rth->rt_flags & (RTCF_BROADCAST | RTCF_MULTICAST)) &&
-		rth->fl.iif && rth->u.dst.rt_next;
-}
-
-static inline int rt_valuable(struct rtable *rth)
+static inline int rt_is_expired(struct rtable *rth)
 {
-	return (rth->rt_flags & (RTCF_REDIRECTED | RTCF_NOTIFY)) ||
-		rth->u.dst.expires;
+	return rth->rt_genid != rt_genid(dev_net(rth->u.dst.dev));
 }
 
-static int rt_may_expire(struct rtable *rth, unsigned long tmo1, unsigned long tmo2)
+/* A remembered route may be handed out again as long as the FIB did
+ * not change under it and the PMTU it learned did not expire.
+ */
+static inline int rt_cache_valid(struct rtable *rth)
 {
-	unsigned long age;
-	int ret = 0;
-
-	if (atomic_read(&rth->u.dst.__refcnt))
-		goto out;
-
-	ret = 1;
-	if (rth->u.dst.expires &&
-	    time_after_eq(jiffies, rth->u.dst.expires))
-		goto out;
-
-	age = jiffies - rth->u.dst.lastuse;
-	ret = 0;
-	if ((age <= tmo1 && !rt_fast_clean(rth)) ||
-	    (age <= tmo2 && rt_valuable(rth)))
-		goto out;
-	ret = 1;
-out:	return ret;
+	if (rt_is_expired(rth))
+		return 0;
+	return !rth->u.dst.expires ||
+		time_before(jiffies, rth->u.dst.expires);
 }
 
-/* Bits of score are:
- * 31: very valuable
- * 30: not quite useless
- * 29..0: usage counter
+/*
+ * A peer learned or forgot something since rt was built. Tell whether
+ * rt no longer matches it, so that it gets rebuilt by rt_init_learned().
+ * Only unicast output routes carry learned state. The comparison is
+ * coarse: a rebuilt route may come out the same, at the cost of one
+ * lookup after which its genid is current.
  */
-static inline u32 rt_score(struct rtable *rt)
+static int rt_peer_changed(struct rtable *rt)
 {
-	u32 score = jiffies - rt->u.dst.lastuse;
-
-	score = ~score & ~(3<<30);
+	u32 genid = rt_peer_genid();
+	struct inet_peer *peer;
+	unsigned long expires = 0;
+	__be32 gw = 0;
 
-	if (rt_valuable(rt))
-		score |= (1<<31);
+	if (likely(rt->rt_peer_genid == genid) ||
+	    rt->fl.iif || rt->rt_type != RTN_UNICAST)
+		return 0;
+	smp_rmb();
 
-	if (!rt->fl.iif ||
-	    !(rt->rt_flags & (RTCF_BROADCAST|RTCF_MULTICAST|RTCF_LOCAL)))
-		score |= (1<<30);
+	if (!rt->peer)
+		rt_bind_peer(rt, 0);
+	peer = rt->peer;
+	if (peer) {
+		if (peer->pmtu_expires &&
+		    time_before(jiffies, peer->pmtu_expires))
+			expires = peer->pmtu_expires;
+		gw = peer->redirect_learned;
+	}
 
-	return score;
-}
+	if (expires != rt->u.dst.expires ||
+	    gw != ((rt->rt_flags & RTCF_REDIRECTED) ? rt->rt_gateway : 0))
+		return 1;
 
-static inline bool rt_caching(const struct net *net)
-{
-	return net->ipv4.current_rt_cache_rebuild_count <=
-		net->ipv4.sysctl_rt_cache_rebuild_count;
+	rt->rt_peer_genid = genid;
+	return 0;
 }
 
-static inline bool compare_hash_inputs(const struct flowi *fl1,
-					const struct flowi *fl2)
+static void rt_add_dev_list(struct rtable *rt)
 {
-	return (__force u32)(((fl1->nl_u.ip4_u.daddr ^ fl2->nl_u.ip4_u.daddr) |
-		(fl1->nl_u.ip4_u.saddr ^ fl2->nl_u.ip4_u.saddr) |
-		(fl1->iif ^ fl2->iif)) == 0);
-}
+	struct rt_dev_list *rl = &per_cpu(rt_dev_list, raw_smp_processor_id());
 
-static inline int compare_keys(struct flowi *fl1, struct flowi *fl2)
-{
-	return ((__force u32)((fl1->nl_u.ip4_u.daddr ^ fl2->nl_u.ip4_u.daddr) |
-		(fl1->nl_u.ip4_u.saddr ^ fl2->nl_u.ip4_u.saddr)) |
-		(fl1->mark ^ fl2->mark) |
-		(*(u16 *)&fl1->nl_u.ip4_u.tos ^
-		 *(u16 *)&fl2->nl_u.ip4_u.tos) |
-		(fl1->oif ^ fl2->oif) |
-		(fl1->iif ^ fl2->iif)) == 0;
+	rt->rt_dev_list = rl;
+	spin_lock_bh(&rl->lock);
+	list_add_tail(&rt->rt_dev_node, &rl->head);
+	spin_unlock_bh(&rl->lock);
 }
 
-static inline int compare_netns(struct rtable *rt1, struct rtable *rt2)
+static void rt_del_dev_list(struct rtable *rt)
 {
-	return dev_net(rt1->u.dst.dev) == dev_net(rt2->u.dst.dev);
-}
+	struct rt_dev_list *rl = rt->rt_dev_list;
 
-static inline int rt_is_expired(struct rtable *rth)
-{
-	return rth->rt_genid != rt_genid(dev_net(rth->u.dst.dev));
+	if (rl) {
+		spin_lock_bh(&rl->lock);
+		list_del(&rt->rt_dev_node);
+		spin_unlock_bh(&rl->lock);
+	}
 }
 
-/*
- * Perform a full scan of hash table and free all entries.
- * Can be called by a softirq or a process.
- * In the later case, we want to be reschedule if necessary
- */
-static void rt_do_flush(int process_context)
+static struct rtable *rt_dst_alloc(void)
 {
-	unsigned int i;
-	struct rtable *rth, *next;
-	struct rtable * tail;
-
-	for (i = 0; i <= rt_hash_mask; i++) {
-		if (process_context && need_resched())
-			cond_resched();
-		rth = rt_hash_table[i].chain;
-		if (!rth)
-			continue;
+	struct rtable *rt = dst_alloc(&ipv4_dst_ops);
 
-		spin_lock_bh(rt_hash_lock_addr(i));
-#ifdef CONFIG_NET_NS
-		{
-		struct rtable ** prev, * p;
-
-		rth = rt_hash_table[i].chain;
-
-		/* defer releasing the head of the list after spin_unlock */
-		for (tail = rth; tail; tail = tail->u.dst.rt_next)
-			if (!rt_is_expired(tail))
-				break;
-		if (rth != tail)
-			rt_hash_table[i].chain = tail;
-
-		/* call rt_free on entries after the tail requiring flush */
-		prev = &rt_hash_table[i].chain;
-		for (p = *prev; p; p = next) {
-			next = p->u.dst.rt_next;
-			if (!rt_is_expired(p)) {
-				prev = &p->u.dst.rt_next;
-			} else {
-				*prev = next;
-				rt_free(p);
-			}
-		}
-		}
-#else
-		rth = rt_hash_table[i].chain;
-		rt_hash_table[i].chain = NULL;
-		tail = NULL;
-#endif
-		spin_unlock_bh(rt_hash_lock_addr(i));
-
-		for (; rth != tail; rth = next) {
-			next = rth->u.dst.rt_next;
-			rt_free(rth);
-		}
+	if (rt) {
+		rt->u.dst.flags = DST_HOST | DST_NOCACHE;
+		rt_add_dev_list(rt);
 	}
+	return rt;
 }
 
 /*
- * While freeing expired entries, we compute average chain length
- * and standard deviation, using fixed-point arithmetic.
- * This to have an estimation of rt_chain_length_max
- *  rt_chain_length_max = max(elasticity, AVG + 4*SD)
- * We use 3 bits for frational part, and 29 (or 61) for magnitude.
+ * Called when dev is unregistered. Routes still held by sockets or by
+ * nexthop slots are moved over to the loopback device, as dst_dev_event()
+ * does for the entries on the dst garbage list.
  */
-
-#define FRACT_BITS 3
-#define ONE (1UL << FRACT_BITS)
-
-static void rt_check_expire(void)
+void rt_flush_dev(struct net_device *dev)
 {
-	static unsigned int rover;
-	unsigned int i = rover, goal;
-	struct rtable *rth, *aux, **rthp;
-	unsigned long samples = 0;
-	unsigned long sum = 0, sum2 = 0;
-	unsigned long delta;
-	u64 mult;
-
-	delta = jiffies - expires_ljiffies;
-	expires_ljiffies = jiffies;
-	mult = ((u64)delta) << rt_hash_log;
-	if (ip_rt_gc_timeout > 1)
-		do_div(mult, ip_rt_gc_timeout);
-	goal = (unsigned int)mult;
-	if (goal > rt_hash_mask)
-		goal = rt_hash_mask + 1;
-	for (; goal > 0; goal--) {
-		unsigned long tmo = ip_rt_gc_timeout;
-		unsigned long length;
-
-		i = (i + 1) & rt_hash_mask;
-		rthp = &rt_hash_table[i].chain;
-
-		if (need_resched())
-			cond_resched();
+	struct rtable *rt, *next;
+	LIST_HEAD(flush);
+	int cpu;
 
-		samples++;
+	for_each_possible_cpu(cpu) {
+		struct rt_dev_list *rl = &per_cpu(rt_dev_list, cpu);
 
-		if (*rthp == NULL)
-			continue;
-		length = 0;
-		spin_lock_bh(rt_hash_lock_addr(i));
-		while ((rth = *rthp) != NULL) {
-			prefetch(rth->u.dst.rt_next);
-			if (rt_is_expired(rth)) {
-				*rthp = rth->u.dst.rt_next;
-				rt_free(rth);
+		spin_lock_bh(&rl->lock);
+		list_for_each_entry_safe(rt, next, &rl->head, rt_dev_node) {
+			if (rt->u.dst.dev != dev ||
+			    !atomic_inc_not_zero(&rt->u.dst.__refcnt))
 				continue;
-			}
-			if (rth->u.dst.expires) {
-				/* Entry is expired even if it is in use */
-				if (time_before_eq(jiffies, rth->u.dst.expires)) {
-nofree:
-					tmo >>= 1;
-					rthp = &rth->u.dst.rt_next;
-					/*
-					 * We only count entries on
-					 * a chain with equal hash inputs once
-					 * so that entries for different QOS
-					 * levels, and other non-hash input
-					 * attributes don't unfairly skew
-					 * the length computation
-					 */
-					for (aux = rt_hash_table[i].chain;;) {
-						if (aux == rth) {
-							length += ONE;
-							break;
-						}
-						if (compare_hash_inputs(&aux->fl, &rth->fl))
-							break;
-						aux = aux->u.dst.rt_next;
-					}
-					continue;
-				}
-			} else if (!rt_may_expire(rth, tmo, ip_rt_gc_timeout))
-				goto nofree;
-
-			/* Cleanup aged off entries. */
-			*rthp = rth->u.dst.rt_next;
-			rt_free(rth);
+			list_move(&rt->rt_dev_node, &flush);
+			rt->rt_dev_list = NULL;
 		}
-		spin_unlock_bh(rt_hash_lock_addr(i));
-		sum += length;
-		sum2 += length*length;
+		spin_unlock_bh(&rl->lock);
 	}
-	if (samples) {
-		unsigned long avg = sum / samples;
-		unsigned long sd = int_sqrt(sum2 / samples - avg*avg);
-		rt_chain_length_max = max_t(unsigned long,
-					ip_rt_gc_elasticity,
-					(avg + 4*sd) >> FRACT_BITS);
+
+	list_for_each_entry_safe(rt, next, &flush, rt_dev_node) {
+		list_del(&rt->rt_dev_node);
+		dst_ifdown(&rt->u.dst, dev, 1);
+		rt_add_dev_list(rt);
+		ip_rt_put(rt);
 	}
-	rover = i;
 }
 
 /*
- * rt_worker_func() is run in process context.
- * we call rt_check_expire() to scan part of the hash table
+ * A route seen in a slot may have been pushed out and released by now;
+ * its memory stays around for the grace period, but it must not be
+ * brought back from a zero refcount.
  */
-static void rt_worker_func(struct work_struct *work)
+static inline int rt_nh_hold(struct rtable *rt)
 {
-	rt_check_expire();
-	schedule_delayed_work(&expires_work, ip_rt_gc_interval);
+	if (!atomic_inc_not_zero(&rt->u.dst.__refcnt))
+		return 0;
+	rt->u.dst.__use++;
+	rt->u.dst.lastuse = jiffies;
+	return 1;
 }
 
-/*
- * Pertubation of rt_genid by a small quantity [1..256]
- * Using 8 bits of shuffling ensure we can call rt_cache_invalidate()
- * many times (2^24) without giving recent rt_genid.
- * Jenkins hash is strong enough that litle changes of rt_genid are OK.
- */
-static void rt_cache_invalidate(struct net *net)
+static int rt_nh_cache_input(struct sk_buff *skb,
+			     struct rt_nh_cache **cachep, unsigned int hash,
+			     __be32 daddr, __be32 saddr, u8 tos, int iif)
 {
-	unsigned char shuffle;
+	struct rt_nh_cache *c;
+	struct rtable *rth;
 
-	get_random_bytes(&shuffle, sizeof(shuffle));
-	atomic_add(shuffle + 1U, &net->ipv4.rt_genid);
+	rcu_read_lock_bh();
+	c = rcu_dereference(*cachep);
+	if (c) {
+		rth = rcu_dereference(c->slot[hash & c->mask]);
+		if (rth &&
+		    ((rth->fl.fl4_dst ^ daddr) |
+		     (rth->fl.fl4_src ^ saddr) |
+		     (rth->fl.iif ^ iif) |
+		     rth->fl.oif |
+		     (rth->fl.fl4_tos ^ tos)) == 0 &&
+		    rth->fl.mark == skb->mark &&
+		    rt_cache_valid(rth) &&
+		    rt_nh_hold(rth)) {
+			RT_CACHE_STAT_INC(in_hit);
+			rcu_read_unlock_bh();
+			skb_dst_set(skb, &rth->u.dst);
+			return 1;
+		}
+	}
+	rcu_read_unlock_bh();
+	return 0;
 }
 
-/*
- * delay < 0  : invalidate cache (fast : entries will be deleted later)
- * delay >= 0 : invalidate & flush cache (can be long)
- */
-void rt_cache_flush(struct net *net, int delay)
+static struct rtable *rt_nh_cache_output(struct rt_nh_cache **cachep,
+					 unsigned int hash,
+					 const struct flowi *flp)
 {
-	rt_cache_invalidate(net);
-	if (delay >= 0)
-		rt_do_flush(!in_softirq());
-}
+	struct rt_nh_cache *c;
+	struct rtable *rth;
 
-/* Flush previous cache invalidated entries from the cache */
-void rt_cache_flush_batch(void)
-{
-	rt_do_flush(!in_softirq());
+	rcu_read_lock_bh();
+	c = rcu_dereference(*cachep);
+	if (c) {
+		rth = rcu_dereference(c->slot[hash & c->mask]);
+		if (rth &&
+		    rth->fl.fl4_dst == flp->fl4_dst &&
+		    rth->fl.fl4_src == flp->fl4_src &&
+		    rth->fl.iif == 0 &&
+		    rth->fl.oif == flp->oif &&
+		    rth->fl.mark == flp->mark &&
+		    !((rth->fl.fl4_tos ^ flp->fl4_tos) &
+			    (IPTOS_RT_MASK | RTO_ONLINK)) &&
+		    rt_cache_valid(rth) &&
+		    !rt_peer_changed(rth) &&
+		    rt_nh_hold(rth)) {
+			RT_CACHE_STAT_INC(out_hit);
+			rcu_read_unlock_bh();
+			return rth;
+		}
+	}
+	rcu_read_unlock_bh();
+	return NULL;
 }
 
 /*
- * We change rt_genid and let gc do the cleanup
+ * The first table of a nexthop is always allowed, the number of those
+ * is bounded by the configuration. Larger ones come out of a global
+ * budget: sources can be spoofed, and input routes are keyed on them.
  */
-static void rt_secret_rebuild(unsigned long __net)
+static struct rt_nh_cache *rt_nh_cache_alloc(unsigned int size)
 {
-	struct net *net = (struct net *)__net;
-	rt_cache_invalidate(net);
-	mod_timer(&net->ipv4.rt_secret_timer, jiffies + ip_rt_secret_interval);
-}
+	size_t bytes = sizeof(struct rt_nh_cache) +
+		       size * sizeof(struct rtable *);
+	struct rt_nh_cache *c;
 
-static void rt_secret_rebuild_oneshot(struct net *net)
-{
-	del_timer_sync(&net->ipv4.rt_secret_timer);
-	rt_cache_invalidate(net);
-	if (ip_rt_secret_interval) {
-		net->ipv4.rt_secret_timer.expires += ip_rt_secret_interval;
-		add_timer(&net->ipv4.rt_secret_timer);
+	if (size > RT_NH_CACHE_MIN &&
+	    atomic_add_return(size, &rt_nh_slots) > ip_rt_max_size) {
+		atomic_sub(size, &rt_nh_slots);
+		return NULL;
 	}
+
+	if (bytes <= PAGE_SIZE)
+		c = kzalloc(bytes, GFP_ATOMIC);
+	else
+		c = (struct rt_nh_cache *)
+			__get_free_pages(GFP_ATOMIC | __GFP_ZERO | __GFP_NOWARN,
+					 get_order(bytes));
+	if (c) {
+		c->mask = size - 1;
+		c->stamp = jiffies;
+	} else if (size > RT_NH_CACHE_MIN)
+		atomic_sub(size, &rt_nh_slots);
+	return c;
 }
 
-static void rt_emergency_hash_rebuild(struct net *net)
+static void rt_nh_cache_free(struct rt_nh_cache *c)
 {
-	if (net_ratelimit()) {
-		printk(KERN_WARNING "Route hash chain too long!\n");
-		printk(KERN_WARNING "Adjust your secret_interval!\n");
-	}
+	unsigned int i, size;
+	size_t bytes;
 
-	rt_secret_rebuild_oneshot(net);
-}
+	if (!c)
+		return;
+	size = c->mask + 1;
+	for (i = 0; i < size; i++)
+		ip_rt_put(c->slot[i]);
 
-/*
-   Short description of GC goals.
+	bytes = sizeof(struct rt_nh_cache) + size * sizeof(struct rtable *);
+	if (bytes <= PAGE_SIZE)
+		kfree(c);
+	else
+		free_pages((unsigned long)c, get_order(bytes));
+	if (size > RT_NH_CACHE_MIN)
+		atomic_sub(size, &rt_nh_slots);
+}
 
-   We want to build algorithm, which will keep routing cache
-   at some equilibrium point, when number of aged off entries
-   is kept approximately equal to newly generated ones.
+static void rt_nh_cache_free_rcu(struct rcu_head *head)
+{
+	rt_nh_cache_free(container_of(head, struct rt_nh_cache, rcu));
+}
 
-   Current expiration strength is variable "expire".
-   We try to adjust it dynamically, so that if networking
-   is idle expires is large enough to keep enough of warm entries,
-   and when load increases it reduces to limit cache size.
+/*
+ * Live routes keep pushing each other out of c: more flows go through
+ * this nexthop than c can hold. Replace it by a table four times larger,
+ * carrying over the routes still valid. Allocation failures are not
+ * fatal, c stays in use and growing is tried again once it turned over
+ * once more.
  */
-
-static int rt_garbage_collect(struct dst_ops *ops)
+static void rt_nh_cache_grow(struct rt_nh_cache **cachep,
+			     struct rt_nh_cache *c)
 {
-	static unsigned long expire = RT_GC_TIMEOUT;
-	static unsigned long last_gc;
-	static int rover;
-	static int equilibrium;
-	struct rtable *rth, **rthp;
-	unsigned long now = jiffies;
-	int goal;
-
-	/*
-	 * Garbage collection is pretty expensive,
-	 * do not make it too frequently.
-	 */
-
-	RT_CACHE_STAT_INC(gc_total);
-
-	if (now - last_gc < ip_rt_gc_min_interval &&
-	    atomic_read(&ipv4_dst_ops.entries) < ip_rt_max_size) {
-		RT_CACHE_STAT_INC(gc_ignored);
-		goto out;
-	}
+	unsigned int i, size = min((c->mask + 1) * 4, rt_nh_cache_max);
+	struct rt_nh_cache *n;
 
-	/* Calculate number of entries, which we want to expire now. */
-	goal = atomic_read(&ipv4_dst_ops.entries) -
-		(ip_rt_gc_elasticity << rt_hash_log);
-	if (goal <= 0) {
-		if (equilibrium < ipv4_dst_ops.gc_thresh)
-			equilibrium = ipv4_dst_ops.gc_thresh;
-		goal = atomic_read(&ipv4_dst_ops.entries) - equilibrium;
-		if (goal > 0) {
-			equilibrium += min_t(unsigned int, goal >> 1, rt_hash_mask + 1);
-			goal = atomic_read(&ipv4_dst_ops.entries) - equilibrium;
-		}
-	} else {
-		/* We are in dangerous area. Try to reduce cache really
-		 * aggressively.
-		 */
-		goal = max_t(unsigned int, goal >> 1, rt_hash_mask + 1);
-		equilibrium = atomic_read(&ipv4_dst_ops.entries) - goal;
+	n = rt_nh_cache_alloc(size);
+	if (!n) {
+		atomic_set(&c->evictions, 0);
+		return;
 	}
 
-	if (now - last_gc >= ip_rt_gc_min_interval)
-		last_gc = now;
+	for (i = 0; i <= c->mask; i++) {
+		struct rtable *rt = rcu_dereference(c->slot[i]);
+		struct rtable **slot;
 
-	if (goal <= 0) {
-		equilibrium += goal;
-		goto work_done;
+		if (!rt || !rt_cache_valid(rt))
+			continue;
+		slot = &n->slot[rt_nh_key(rt) & n->mask];
+		if (*slot || !atomic_inc_not_zero(&rt->u.dst.__refcnt))
+			continue;
+		*slot = rt;
 	}
 
-	do {
-		int i, k;
-
-		for (i = rt_hash_mask, k = rover; i >= 0; i--) {
-			unsigned long tmo = expire;
-
-			k = (k + 1) & rt_hash_mask;
-			rthp = &rt_hash_table[k].chain;
-			spin_lock_bh(rt_hash_lock_addr(k));
-			while ((rth = *rthp) != NULL) {
-				if (!rt_is_expired(rth) &&
-					!rt_may_expire(rth, tmo, expire)) {
-					tmo >>= 1;
-					rthp = &rth->u.dst.rt_next;
-					continue;
-				}
-				*rthp = rth->u.dst.rt_next;
-				rt_free(rth);
-				goal--;
-			}
-			spin_unlock_bh(rt_hash_lock_addr(k));
-			if (goal <= 0)
-				break;
-		}
-		rover = k;
-
-		if (goal <= 0)
-			goto work_done;
-
-		/* Goal is not achieved. We stop process if:
-
-		   - if expire reduced to zero. Otherwise, expire is halfed.
-		   - if table is not full.
-		   - if we are called from interrupt.
-		   - jiffies check is just fallback/debug loop breaker.
-		     We will not spin here for long time in any case.
-		 */
-
-		RT_CACHE_STAT_INC(gc_goal_miss);
-
-		if (expire == 0)
-			break;
-
-		expire >>= 1;
-#if RT_CACHE_DEBUG >= 2
-		printk(KERN_DEBUG "expire>> %u %d %d %d\n", expire,
-				atomic_read(&ipv4_dst_ops.entries), goal, i);
-#endif
-
-		if (atomic_read(&ipv4_dst_ops.entries) < ip_rt_max_size)
-			goto out;
-	} while (!in_softirq() && time_before_eq(jiffies, now));
-
-	if (atomic_read(&ipv4_dst_ops.entries) < ip_rt_max_size)
-		goto out;
-	if (net_ratelimit())
-		printk(KERN_WARNING "dst cache overflow\n");
-	RT_CACHE_STAT_INC(gc_dst_overflow);
-	return 1;
-
-work_done:
-	expire += ip_rt_gc_min_interval;
-	if (expire > ip_rt_gc_timeout ||
-	    atomic_read(&ipv4_dst_ops.entries) < ipv4_dst_ops.gc_thresh)
-		expire = ip_rt_gc_timeout;
-#if RT_CACHE_DEBUG >= 2
-	printk(KERN_DEBUG "expire++ %u %d %d %d\n", expire,
-			atomic_read(&ipv4_dst_ops.entries), goal, rover);
-#endif
-out:	return 0;
+	if (cmpxchg(cachep, c, n) != c) {
+		rt_nh_cache_free(n);
+		return;
+	}
+	call_rcu_bh(&c->rcu, rt_nh_cache_free_rcu);
 }
 
-static int rt_intern_hash(unsigned hash, struct rtable *rt,
-			  struct rtable **rp, struct sk_buff *skb)
+static void rt_nh_cache_insert(struct rt_nh_cache **cachep,
+			       unsigned int hash, struct rtable *rt)
 {
-	struct rtable	*rth, **rthp;
-	unsigned long	now;
-	struct rtable *cand, **candp;
-	u32 		min_score;
-	int		chain_length;
-	int attempts = !in_softirq();
+	struct rt_nh_cache *c, *other;
+	struct rtable *old;
 
-restart:
-	chain_length = 0;
-	min_score = ~(u32)0;
-	cand = NULL;
-	candp = NULL;
-	now = jiffies;
-
-	if (!rt_caching(dev_net(rt->u.dst.dev))) {
-		/*
-		 * If we're not caching, just tell the caller we
-		 * were successful and don't touch the route.  The
-		 * caller hold the sole reference to the cache entry, and
-		 * it will be released when the caller is done with it.
-		 * If we drop it here, the callers have no way to resolve routes
-		 * when we're not caching.  Instead, just point *rp at rt, so
-		 * the caller gets a single use out of the route
-		 * Note that we do rt_free on this new route entry, so that
-		 * once its refcount hits zero, we are still able to reap it
-		 * (Thanks Alexey)
-		 * Note also the rt_free uses call_rcu.  We don't actually
-		 * need rcu protection here, this is just our path to get
-		 * on the route gc list.
-		 */
-
-		if (rt->rt_type == RTN_UNICAST || rt->fl.iif == 0) {
-			int err = arp_bind_neighbour(&rt->u.dst);
-			if (err) {
-				if (net_ratelimit())
-					printk(KERN_WARNING
-					    "Neighbour table failure & not caching routes.\n");
-				rt_drop(rt);
-				return err;
-			}
+	rcu_read_lock_bh();
+	c = rcu_dereference(*cachep);
+	if (!c) {
+		c = rt_nh_cache_alloc(RT_NH_CACHE_MIN);
+		if (!c)
+			goto out;
+		other = cmpxchg(cachep, NULL, c);
+		if (other) {
+			rt_nh_cache_free(c);
+			c = other;
 		}
-
-		rt_free(rt);
-		goto skip_hashing;
 	}
+	dst_hold(&rt->u.dst);
+	old = xchg(&c->slot[hash & c->mask], rt);
+	if (!old)
+		goto out;
 
-	rthp = &rt_hash_table[hash].chain;
-
-	spin_lock_bh(rt_hash_lock_addr(hash));
-	while ((rth = *rthp) != NULL) {
-		if (rt_is_expired(rth)) {
-			*rthp = rth->u.dst.rt_next;
-			rt_free(rth);
-			continue;
-		}
-		if (compare_keys(&rth->fl, &rt->fl) && compare_netns(rth, rt)) {
-			/* Put it first */
-			*rthp = rth->u.dst.rt_next;
-			/*
-			 * Since lookup is lockfree, the deletion
-			 * must be visible to another weakly ordered CPU before
-			 * the insertion at the start of the hash chain.
-			 */
-			rcu_assign_pointer(rth->u.dst.rt_next,
-					   rt_hash_table[hash].chain);
-			/*
-			 * Since lookup is lockfree, the update writes
-			 * must be ordered for consistency on SMP.
-			 */
-			rcu_assign_pointer(rt_hash_table[hash].chain, rth);
-
-			dst_use(&rth->u.dst, now);
-			spin_unlock_bh(rt_hash_lock_addr(hash));
-
-			rt_drop(rt);
-			if (rp)
-				*rp = rth;
-			else
-				skb_dst_set(skb, &rth->u.dst);
-			return 0;
+	/* Count the valid routes of other flows we had to push out. If
+	 * the table turned over within a second, it is too small.
+	 */
+	if ((old->fl.fl4_dst != rt->fl.fl4_dst ||
+	     old->fl.fl4_src != rt->fl.fl4_src) &&
+	    rt_cache_valid(old) && c->mask + 1 < rt_nh_cache_max) {
+		if (time_after(jiffies, c->stamp + HZ)) {
+			c->stamp = jiffies;
+			atomic_set(&c->evictions, 0);
 		}
+		if (atomic_inc_return(&c->evictions) > c->mask)
+			rt_nh_cache_grow(cachep, c);
+	}
+	ip_rt_put(old);
+out:
+	rcu_read_unlock_bh();
+}
 
-		if (!atomic_read(&rth->u.dst.__refcnt)) {
-			u32 score = rt_score(rth);
-
-			if (score <= min_score) {
-				cand = rth;
-				candp = rthp;
-				min_score = score;
-			}
-		}
+/* Called from free_fib_info(), nobody can resolve through nh any more. */
+void rt_nh_flush(struct fib_nh *nh)
+{
+	rt_nh_cache_free(nh->nh_rth_input);
+	nh->nh_rth_input = NULL;
+	rt_nh_cache_free(nh->nh_rth_output);
+	nh->nh_rth_output = NULL;
+}
 
-		chain_length++;
+/*
+ * Pertubation of rt_genid by a small quantity [1..256]
+ * Using 8 bits of shuffling ensure we can call rt_cache_invalidate()
+ * many times (2^24) without giving recent rt_genid.
+ * Jenkins hash is strong enough that litle changes of rt_genid are OK.
+ */
+static void rt_cache_invalidate(struct net *net)
+{
+	unsigned char shuffle;
 
-		rthp = &rth->u.dst.rt_next;
-	}
+	get_random_bytes(&shuffle, sizeof(shuffle));
+	atomic_add(shuffle + 1U, &net->ipv4.rt_genid);
+}
 
-	if (cand) {
-		/* ip_rt_gc_elasticity used to be average length of chain
-		 * length, when exceeded gc becomes really aggressive.
-		 *
-		 * The second limit is less certain. At the moment it allows
-		 * only 2 entries per bucket. We will see.
-		 */
-		if (chain_length > ip_rt_gc_elasticity) {
-			*candp = cand->u.dst.rt_next;
-			rt_free(cand);
-		}
-	} else {
-		if (chain_length > rt_chain_length_max) {
-			struct net *net = dev_net(rt->u.dst.dev);
-			int num = ++net->ipv4.current_rt_cache_rebuild_count;
-			if (!rt_caching(dev_net(rt->u.dst.dev))) {
-				printk(KERN_WARNING "%s: %d rebuilds is over limit, route caching disabled\n",
-					rt->u.dst.dev->name, num);
-			}
-			rt_emergency_hash_rebuild(dev_net(rt->u.dst.dev));
-		}
-	}
+/*
+ * Changing rt_genid is all it takes: nexthop slots replace stale routes
+ * on their next lookup and sockets drop theirs in ipv4_dst_check().
+ * delay is kept for the callers, there is nothing left to flush.
+ */
+void rt_cache_flush(struct net *net, int delay)
+{
+	rt_cache_invalidate(net);
+}
 
+/*
+ * Bind a freshly built route to its neighbour. Routes resolved through
+ * a nexthop are then remembered there for the next lookup with the same
+ * keys.
+ */
+static int rt_finish(struct rtable *rt, struct rt_nh_cache **cachep,
+		     unsigned int hash)
+{
 	/* Try to bind route to arp only if it is output
 	   route or unicast forwarding path.
 	 */
 	if (rt->rt_type == RTN_UNICAST || rt->fl.iif == 0) {
 		int err = arp_bind_neighbour(&rt->u.dst);
 		if (err) {
-			spin_unlock_bh(rt_hash_lock_addr(hash));
-
-			if (err != -ENOBUFS) {
-				rt_drop(rt);
-				return err;
-			}
-
-			/* Neighbour tables are full and nothing
-			   can be released. Try to shrink route cache,
-			   it is most likely it holds some neighbour records.
-			 */
-			if (attempts-- > 0) {
-				int saved_elasticity = ip_rt_gc_elasticity;
-				int saved_int = ip_rt_gc_min_interval;
-				ip_rt_gc_elasticity	= 1;
-				ip_rt_gc_min_interval	= 0;
-				rt_garbage_collect(&ipv4_dst_ops);
-				ip_rt_gc_min_interval	= saved_int;
-				ip_rt_gc_elasticity	= saved_elasticity;
-				goto restart;
-			}
-
-			if (net_ratelimit())
+			if (err == -ENOBUFS && net_ratelimit())
 				printk(KERN_WARNING "Neighbour table overflow.\n");
-			rt_drop(rt);
-			return -ENOBUFS;
+			ip_rt_put(rt);
+			return err;
 		}
 	}
 
-	rt->u.dst.rt_next = rt_hash_table[hash].chain;
-
-#if RT_CACHE_DEBUG >= 2
-	if (rt->u.dst.rt_next) {
-		struct rtable *trt;
-		printk(KERN_DEBUG "rt_cache @%02x: %pI4",
-		       hash, &rt->rt_dst);
-		for (trt = rt->u.dst.rt_next; trt; trt = trt->u.dst.rt_next)
-			printk(" . %pI4", &trt->rt_dst);
-		printk("\n");
-	}
-#endif
-	/*
-	 * Since lookup is lockfree, we must make sure
-	 * previous writes to rt are comitted to memory
-	 * before making rt visible to other CPUS.
-	 */
-	rcu_assign_pointer(rt_hash_table[hash].chain, rt);
-
-	spin_unlock_bh(rt_hash_lock_addr(hash));
-
-skip_hashing:
-	if (rp)
-		*rp = rt;
-	else
-		skb_dst_set(skb, &rt->u.dst);
+	if (cachep)
+		rt_nh_cache_insert(cachep, hash, rt);
 	return 0;
 }
 
@@ -1320,33 +966,41 @@ void __ip_select_ident(struct iphdr *iph, struct dst_entry *dst, int more)
 	ip_select_fb_ident(iph);
 }
 
-static void rt_del(unsigned hash, struct rtable *rt)
+/*
+ * Only believe a redirect sent by the gateway we would use for daddr,
+ * or by the one an earlier redirect told us about.
+ */
+static int rt_redirect_from_gw(struct net *net, struct inet_peer *peer,
+			       __be32 daddr, __be32 old_gw,
+			       struct net_device *dev)
 {
-	struct rtable **rthp, *aux;
+	struct flowi fl = { .nl_u = { .ip4_u = { .daddr = daddr } } };
+	struct fib_result res;
+	int nhsel, ret = 0;
 
-	rthp = &rt_hash_table[hash].chain;
-	spin_lock_bh(rt_hash_lock_addr(hash));
-	ip_rt_put(rt);
-	while ((aux = *rthp) != NULL) {
-		if (aux == rt || rt_is_expired(aux)) {
-			*rthp = aux->u.dst.rt_next;
-			rt_free(aux);
-			continue;
+	if (peer->redirect_learned == old_gw)
+		return 1;
+
+	if (fib_lookup(net, &fl, &res))
+		return 0;
+	for (nhsel = 0; nhsel < res.fi->fib_nhs; nhsel++) {
+		struct fib_nh *nh = &res.fi->fib_nh[nhsel];
+
+		if (nh->nh_gw == old_gw && nh->nh_dev == dev) {
+			ret = 1;
+			break;
 		}
-		rthp = &aux->u.dst.rt_next;
 	}
-	spin_unlock_bh(rt_hash_lock_addr(hash));
+	fib_res_put(&res);
+	return ret;
 }
 
 void ip_rt_redirect(__be32 old_gw, __be32 daddr, __be32 new_gw,
 		    __be32 saddr, struct net_device *dev)
 {
-	int i, k;
 	struct in_device *in_dev = in_dev_get(dev);
-	struct rtable *rth, **rthp;
-	__be32  skeys[2] = { saddr, 0 };
-	int  ikeys[2] = { dev->ifindex, 0 };
-	struct netevent_redirect netevent;
+	struct inet_peer *peer;
+	struct neighbour *n;
 	struct net *net;
 
 	if (!in_dev)
@@ -1358,9 +1012,6 @@ void ip_rt_redirect(__be32 old_gw, __be32 daddr, __be32 new_gw,
 	    || ipv4_is_zeronet(new_gw))
 		goto reject_redirect;
 
-	if (!rt_caching(net))
-		goto reject_redirect;
-
 	if (!IN_DEV_SHARED_MEDIA(in_dev)) {
 		if (!inet_addr_onlink(in_dev, new_gw, old_gw))
 			goto reject_redirect;
@@ -1371,98 +1022,28 @@ void ip_rt_redirect(__be32 old_gw, __be32 daddr, __be32 new_gw,
 			goto reject_redirect;
 	}
 
-	for (i = 0; i < 2; i++) {
-		for (k = 0; k < 2; k++) {
-			unsigned hash = rt_hash(daddr, skeys[i], ikeys[k],
-						rt_genid(net));
-
-			rthp=&rt_hash_table[hash].chain;
-
-			rcu_read_lock();
-			while ((rth = rcu_dereference(*rthp)) != NULL) {
-				struct rtable *rt;
-
-				if (rth->fl.fl4_dst != daddr ||
-				    rth->fl.fl4_src != skeys[i] ||
-				    rth->fl.oif != ikeys[k] ||
-				    rth->fl.iif != 0 ||
-				    rt_is_expired(rth) ||
-				    !net_eq(dev_net(rth->u.dst.dev), net)) {
-					rthp = &rth->u.dst.rt_next;
-					continue;
-				}
-
-				if (rth->rt_dst != daddr ||
-				    rth->rt_src != saddr ||
-				    rth->u.dst.error ||
-				    rth->rt_gateway != old_gw ||
-				    rth->u.dst.dev != dev)
-					break;
-
-				dst_hold(&rth->u.dst);
-				rcu_read_unlock();
-
-				rt = dst_alloc(&ipv4_dst_ops);
-				if (rt == NULL) {
-					ip_rt_put(rth);
-					in_dev_put(in_dev);
-					return;
-				}
-
-				/* Copy all the information. */
-				*rt = *rth;
-				rt->u.dst.__use		= 1;
-				atomic_set(&rt->u.dst.__refcnt, 1);
-				rt->u.dst.child		= NULL;
-				if (rt->u.dst.dev)
-					dev_hold(rt->u.dst.dev);
-				if (rt->idev)
-					in_dev_hold(rt->idev);
-				rt->u.dst.obsolete	= -1;
-				rt->u.dst.lastuse	= jiffies;
-				rt->u.dst.path		= &rt->u.dst;
-				rt->u.dst.neighbour	= NULL;
-				rt->u.dst.hh		= NULL;
-#ifdef CONFIG_XFRM
-				rt->u.dst.xfrm		= NULL;
-#endif
-				rt->rt_genid		= rt_genid(net);
-				rt->rt_flags		|= RTCF_REDIRECTED;
-
-				/* Gateway is different ... */
-				rt->rt_gateway		= new_gw;
-
-				/* Redirect received -> path was valid */
-				dst_confirm(&rth->u.dst);
-
-				if (rt->peer)
-					atomic_inc(&rt->peer->refcnt);
-
-				if (arp_bind_neighbour(&rt->u.dst) ||
-				    !(rt->u.dst.neighbour->nud_state &
-					    NUD_VALID)) {
-					if (rt->u.dst.neighbour)
-						neigh_event_send(rt->u.dst.neighbour, NULL);
-					ip_rt_put(rth);
-					rt_drop(rt);
-					goto do_next;
-				}
-
-				netevent.old = &rth->u.dst;
-				netevent.new = &rt->u.dst;
-				call_netevent_notifiers(NETEVENT_REDIRECT,
-							&netevent);
+	peer = inet_getpeer(daddr, 1);
+	if (!peer)
+		goto out;
+	if (!rt_redirect_from_gw(net, peer, daddr, old_gw, dev)) {
+		inet_putpeer(peer);
+		goto reject_redirect;
+	}
 
-				rt_del(hash, rth);
-				if (!rt_intern_hash(hash, rt, &rt, NULL))
-					ip_rt_put(rt);
-				goto do_next;
-			}
-			rcu_read_unlock();
-		do_next:
-			;
+	n = __neigh_lookup(&arp_tbl, &new_gw, dev, 1);
+	if (n) {
+		if (!(n->nud_state & NUD_VALID)) {
+			neigh_event_send(n, NULL);
+		} else {
+			/* Routes towards daddr pick up the new gateway */
+			peer->redirect_learned = new_gw;
+			rt_peer_genid_bump();
+			call_netevent_notifiers(NETEVENT_NEIGH_UPDATE, n);
 		}
+		neigh_release(n);
 	}
+	inet_putpeer(peer);
+out:
 	in_dev_put(in_dev);
 	return;
 
@@ -1488,14 +1069,19 @@ static struct dst_entry *ipv4_negative_advice(struct dst_entry *dst)
 			ret = NULL;
 		} else if ((rt->rt_flags & RTCF_REDIRECTED) ||
 			   rt->u.dst.expires) {
-			unsigned hash = rt_hash(rt->fl.fl4_dst, rt->fl.fl4_src,
-						rt->fl.oif,
-						rt_genid(dev_net(dst->dev)));
 #if RT_CACHE_DEBUG >= 1
 			printk(KERN_DEBUG "ipv4_negative_advice: redirect to %pI4/%02x dropped\n",
 				&rt->rt_dst, rt->fl.fl4_tos);
 #endif
-			rt_del(hash, rt);
+			/* What we learned about the path did not help,
+			 * forget it and rebuild the route without it.
+			 */
+			if (rt->peer) {
+				rt->peer->redirect_learned = 0;
+				rt->peer->pmtu_expires = 0;
+				rt_peer_genid_bump();
+			}
+			ip_rt_put(rt);
 			ret = NULL;
 		}
 	}
@@ -1623,75 +1209,59 @@ static inline unsigned short guess_mtu(unsigned short old_mtu)
 	return 68;
 }
 
+static void rt_learn_pmtu(struct inet_peer *peer, u32 mtu)
+{
+	unsigned long expires = jiffies + ip_rt_mtu_expires;
+
+	if (!expires)
+		expires = 1UL;
+	if (!peer->pmtu_expires ||
+	    time_after_eq(jiffies, peer->pmtu_expires) ||
+	    mtu < peer->pmtu_learned) {
+		peer->pmtu_learned = mtu;
+		peer->pmtu_expires = expires;
+	}
+}
+
 unsigned short ip_rt_frag_needed(struct net *net, struct iphdr *iph,
 				 unsigned short new_mtu,
 				 struct net_device *dev)
 {
-	int i, k;
 	unsigned short old_mtu = ntohs(iph->tot_len);
-	struct rtable *rth;
-	int  ikeys[2] = { dev->ifindex, 0 };
-	__be32  skeys[2] = { iph->saddr, 0, };
-	__be32  daddr = iph->daddr;
-	unsigned short est_mtu = 0;
+	unsigned short mtu = new_mtu;
+	struct inet_peer *peer;
 
 	if (ipv4_config.no_pmtu_disc)
 		return 0;
 
-	for (k = 0; k < 2; k++) {
-		for (i = 0; i < 2; i++) {
-			unsigned hash = rt_hash(daddr, skeys[i], ikeys[k],
-						rt_genid(net));
-
-			rcu_read_lock();
-			for (rth = rcu_dereference(rt_hash_table[hash].chain); rth;
-			     rth = rcu_dereference(rth->u.dst.rt_next)) {
-				unsigned short mtu = new_mtu;
-
-				if (rth->fl.fl4_dst != daddr ||
-				    rth->fl.fl4_src != skeys[i] ||
-				    rth->rt_dst != daddr ||
-				    rth->rt_src != iph->saddr ||
-				    rth->fl.oif != ikeys[k] ||
-				    rth->fl.iif != 0 ||
-				    dst_metric_locked(&rth->u.dst, RTAX_MTU) ||
-				    !net_eq(dev_net(rth->u.dst.dev), net) ||
-				    rt_is_expired(rth))
-					continue;
-
-				if (new_mtu < 68 || new_mtu >= old_mtu) {
-
-					/* BSD 4.2 compatibility hack :-( */
-					if (mtu == 0 &&
-					    old_mtu >= dst_mtu(&rth->u.dst) &&
-					    old_mtu >= 68 + (iph->ihl << 2))
-						old_mtu -= iph->ihl << 2;
-
-					mtu = guess_mtu(old_mtu);
-				}
-				if (mtu <= dst_mtu(&rth->u.dst)) {
-					if (mtu < dst_mtu(&rth->u.dst)) {
-						dst_confirm(&rth->u.dst);
-						if (mtu < ip_rt_min_pmtu) {
-							mtu = ip_rt_min_pmtu;
-							rth->u.dst.metrics[RTAX_LOCK-1] |=
-								(1 << RTAX_MTU);
-						}
-						rth->u.dst.metrics[RTAX_MTU-1] = mtu;
-						dst_set_expires(&rth->u.dst,
-							ip_rt_mtu_expires);
-					}
-					est_mtu = mtu;
-				}
-			}
-			rcu_read_unlock();
-		}
+	if (new_mtu < 68 || new_mtu >= old_mtu) {
+
+		/* BSD 4.2 compatibility hack :-( */
+		if (mtu == 0 &&
+		    old_mtu >= 68 + (iph->ihl << 2))
+			old_mtu -= iph->ihl << 2;
+
+		mtu = guess_mtu(old_mtu);
+	}
+	if (mtu < ip_rt_min_pmtu)
+		mtu = ip_rt_min_pmtu;
+
+	/* Remembered per destination and applied by rt_init_learned() to
+	 * the routes rebuilt once rt_peer_changed() notices.
+	 */
+	peer = inet_getpeer(iph->daddr, 1);
+	if (peer) {
+		rt_learn_pmtu(peer, mtu);
+		inet_putpeer(peer);
+		rt_peer_genid_bump();
 	}
-	return est_mtu ? : new_mtu;
+	return mtu;
 }
 
 static void ip_rt_update_pmtu(struct dst_entry *dst, u32 mtu)
 {
+	struct rtable *rt = (struct rtable *) dst;
+
 	if (dst_mtu(dst) > mtu && mtu >= 68 &&
 	    !(dst_metric_locked(dst, RTAX_MTU))) {
 		if (mtu < ip_rt_min_pmtu) {
@@ -1700,13 +1270,23 @@ static void ip_rt_update_pmtu(struct dst_entry *dst, u32 mtu)
 		}
 		dst->metrics[RTAX_MTU-1] = mtu;
 		dst_set_expires(dst, ip_rt_mtu_expires);
+		if (rt->fl.iif == 0) {
+			if (rt->peer == NULL)
+				rt_bind_peer(rt, 1);
+			if (rt->peer) {
+				rt_learn_pmtu(rt->peer, mtu);
+				rt_peer_genid_bump();
+			}
+		}
 		call_netevent_notifiers(NETEVENT_PMTU_UPDATE, dst);
 	}
 }
 
 static struct dst_entry *ipv4_dst_check(struct dst_entry *dst, u32 cookie)
 {
-	if (rt_is_expired((struct rtable *)dst))
+	struct rtable *rt = (struct rtable *)dst;
+
+	if (rt_is_expired(rt) || rt_peer_changed(rt))
 		return NULL;
 	return dst;
 }
@@ -1717,6 +1297,8 @@ static void ipv4_dst_destroy(struct dst_entry *dst)
 	struct inet_peer *peer = rt->peer;
 	struct in_device *idev = rt->idev;
 
+	rt_del_dev_list(rt);
+
 	if (peer) {
 		rt->peer = NULL;
 		inet_putpeer(peer);
@@ -1840,14 +1422,47 @@ static void rt_set_nexthop(struct rtable *rt, struct fib_result *res, u32 itag)
 	rt->rt_type = res->type;
 }
 
+/*
+ * Apply what PMTU discovery and ICMP redirects taught us about the
+ * destination of an output route, see ip_rt_frag_needed() and
+ * ip_rt_redirect().
+ */
+static void rt_init_learned(struct rtable *rt)
+{
+	struct inet_peer *peer;
+
+	rt->rt_peer_genid = rt_peer_genid();
+	smp_rmb();
+
+	rt_bind_peer(rt, 0);
+	peer = rt->peer;
+	if (!peer)
+		return;
+
+	if (peer->pmtu_expires &&
+	    time_before(jiffies, peer->pmtu_expires) &&
+	    peer->pmtu_learned < dst_mtu(&rt->u.dst) &&
+	    !dst_metric_locked(&rt->u.dst, RTAX_MTU)) {
+		rt->u.dst.metrics[RTAX_MTU-1] = peer->pmtu_learned;
+		rt->u.dst.expires = peer->pmtu_expires;
+	}
+
+	if (peer->redirect_learned &&
+	    peer->redirect_learned != rt->rt_gateway &&
+	    rt->rt_gateway != rt->rt_dst) {
+		rt->rt_gateway = peer->redirect_learned;
+		rt->rt_flags |= RTCF_REDIRECTED;
+	}
+}
+
 static int ip_route_input_mc(struct sk_buff *skb, __be32 daddr, __be32 saddr,
 				u8 tos, struct net_device *dev, int our)
 {
-	unsigned hash;
 	struct rtable *rth;
 	__be32 spec_dst;
 	struct in_device *in_dev = in_dev_get(dev);
 	u32 itag = 0;
+	int err;
 
 	/* Primary sanity checks. */
 
@@ -1870,7 +1485,7 @@ static int ip_route_input_mc(struct sk_buff *skb, __be32 daddr, __be32 saddr,
 					dev, &spec_dst, &itag, 0) < 0)
 		goto e_inval;
 
-	rth = dst_alloc(&ipv4_dst_ops);
+	rth = rt_dst_alloc();
 	if (!rth)
 		goto e_nobufs;
 
@@ -1878,7 +1493,6 @@ static int ip_route_input_mc(struct sk_buff *skb, __be32 daddr, __be32 saddr,
 	rth->u.dst.obsolete = -1;
 
 	atomic_set(&rth->u.dst.__refcnt, 1);
-	rth->u.dst.flags= DST_HOST;
 	if (IN_DEV_CONF_GET(in_dev, NOPOLICY))
 		rth->u.dst.flags |= DST_NOPOLICY;
 	rth->fl.fl4_dst	= daddr;
@@ -1913,8 +1527,11 @@ static int ip_route_input_mc(struct sk_buff *skb, __be32 daddr, __be32 saddr,
 	RT_CACHE_STAT_INC(in_slow_mc);
 
 	in_dev_put(in_dev);
-	hash = rt_hash(daddr, saddr, dev->ifindex, rt_genid(dev_net(dev)));
-	return rt_intern_hash(hash, rth, NULL, skb);
+	err = rt_finish(rth, NULL, 0);
+	if (err)
+		return err;
+	skb_dst_set(skb, &rth->u.dst);
+	return 0;
 
 e_nobufs:
 	in_dev_put(in_dev);
@@ -2014,14 +1631,13 @@ static int __mkroute_input(struct sk_buff *skb,
 	}
 
 
-	rth = dst_alloc(&ipv4_dst_ops);
+	rth = rt_dst_alloc();
 	if (!rth) {
 		err = -ENOBUFS;
 		goto cleanup;
 	}
 
 	atomic_set(&rth->u.dst.__refcnt, 1);
-	rth->u.dst.flags= DST_HOST;
 	if (IN_DEV_CONF_GET(in_dev, NOPOLICY))
 		rth->u.dst.flags |= DST_NOPOLICY;
 	if (IN_DEV_CONF_GET(out_dev, NOXFRM))
@@ -2065,23 +1681,29 @@ static int ip_mkroute_input(struct sk_buff *skb,
 			    __be32 daddr, __be32 saddr, u32 tos)
 {
 	struct rtable* rth = NULL;
-	int err;
+	struct rt_nh_cache **cachep;
 	unsigned hash;
+	int err;
 
 #ifdef CONFIG_IP_ROUTE_MULTIPATH
 	if (res->fi && res->fi->fib_nhs > 1 && fl->oif == 0)
 		fib_select_multipath(fl, res);
 #endif
 
-	/* create a routing cache entry */
+	cachep = &FIB_RES_NH(*res).nh_rth_input;
+	hash = rt_nh_hash(daddr, saddr, fl->iif);
+	if (rt_nh_cache_input(skb, cachep, hash, daddr, saddr, tos, fl->iif))
+		return 0;
+
 	err = __mkroute_input(skb, res, in_dev, daddr, saddr, tos, &rth);
 	if (err)
 		return err;
 
-	/* put it into the cache */
-	hash = rt_hash(daddr, saddr, fl->iif,
-		       rt_genid(dev_net(rth->u.dst.dev)));
-	return rt_intern_hash(hash, rth, NULL, skb);
+	err = rt_finish(rth, cachep, hash);
+	if (err)
+		return err;
+	skb_dst_set(skb, &rth->u.dst);
+	return 0;
 }
 
 /*
@@ -2110,7 +1732,8 @@ static int ip_route_input_slow(struct sk_buff *skb, __be32 daddr, __be32 saddr,
 	unsigned	flags = 0;
 	u32		itag = 0;
 	struct rtable * rth;
-	unsigned	hash;
+	struct rt_nh_cache **cachep = NULL;
+	unsigned	hash = 0;
 	__be32		spec_dst;
 	int		err = -EINVAL;
 	int		free_res = 0;
@@ -2165,6 +1788,15 @@ static int ip_route_input_slow(struct sk_buff *skb, __be32 daddr, __be32 saddr,
 
 	if (res.type == RTN_LOCAL) {
 		int result;
+
+		cachep = &FIB_RES_NH(res).nh_rth_input;
+		hash = rt_nh_hash(daddr, saddr, fl.iif);
+		if (rt_nh_cache_input(skb, cachep, hash, daddr, saddr, tos,
+				      fl.iif)) {
+			err = 0;
+			goto done;
+		}
+
 		result = fib_validate_source(saddr, daddr, tos,
 					     net->loopback_dev->ifindex,
 					     dev, &spec_dst, &itag, skb->mark);
@@ -2207,7 +1839,7 @@ brd_input:
 	RT_CACHE_STAT_INC(in_brd);
 
 local_input:
-	rth = dst_alloc(&ipv4_dst_ops);
+	rth = rt_dst_alloc();
 	if (!rth)
 		goto e_nobufs;
 
@@ -2216,7 +1848,6 @@ local_input:
 	rth->rt_genid = rt_genid(net);
 
 	atomic_set(&rth->u.dst.__refcnt, 1);
-	rth->u.dst.flags= DST_HOST;
 	if (IN_DEV_CONF_GET(in_dev, NOPOLICY))
 		rth->u.dst.flags |= DST_NOPOLICY;
 	rth->fl.fl4_dst	= daddr;
@@ -2243,8 +1874,9 @@ local_input:
 		rth->rt_flags 	&= ~RTCF_LOCAL;
 	}
 	rth->rt_type	= res.type;
-	hash = rt_hash(daddr, saddr, fl.iif, rt_genid(net));
-	err = rt_intern_hash(hash, rth, NULL, skb);
+	err = rt_finish(rth, cachep, hash);
+	if (!err)
+		skb_dst_set(skb, &rth->u.dst);
 	goto done;
 
 no_route:
@@ -2286,41 +1918,8 @@ martian_source:
 int ip_route_input(struct sk_buff *skb, __be32 daddr, __be32 saddr,
 		   u8 tos, struct net_device *dev)
 {
-	struct rtable * rth;
-	unsigned	hash;
-	int iif = dev->ifindex;
-	struct net *net;
-
-	net = dev_net(dev);
-
-	if (!rt_caching(net))
-		goto skip_cache;
-
 	tos &= IPTOS_RT_MASK;
-	hash = rt_hash(daddr, saddr, iif, rt_genid(net));
-
-	rcu_read_lock();
-	for (rth = rcu_dereference(rt_hash_table[hash].chain); rth;
-	     rth = rcu_dereference(rth->u.dst.rt_next)) {
-		if (((rth->fl.fl4_dst ^ daddr) |
-		     (rth->fl.fl4_src ^ saddr) |
-		     (rth->fl.iif ^ iif) |
-		     rth->fl.oif |
-		     (rth->fl.fl4_tos ^ tos)) == 0 &&
-		    rth->fl.mark == skb->mark &&
-		    net_eq(dev_net(rth->u.dst.dev), net) &&
-		    !rt_is_expired(rth)) {
-			dst_use(&rth->u.dst, jiffies);
-			RT_CACHE_STAT_INC(in_hit);
-			rcu_read_unlock();
-			skb_dst_set(skb, &rth->u.dst);
-			return 0;
-		}
-		RT_CACHE_STAT_INC(in_hlist_search);
-	}
-	rcu_read_unlock();
 
-skip_cache:
 	/* Multicast recognition logic is moved from route cache to here.
 	   The problem was that too many Ethernet cards have broken/missing
 	   hardware multicast filters :-( As result the host on multicasting
@@ -2412,14 +2011,13 @@ static int __mkroute_output(struct rtable **result,
 	}
 
 
-	rth = dst_alloc(&ipv4_dst_ops);
+	rth = rt_dst_alloc();
 	if (!rth) {
 		err = -ENOBUFS;
 		goto cleanup;
 	}
 
 	atomic_set(&rth->u.dst.__refcnt, 1);
-	rth->u.dst.flags= DST_HOST;
 	if (IN_DEV_CONF_GET(in_dev, NOXFRM))
 		rth->u.dst.flags |= DST_NOXFRM;
 	if (IN_DEV_CONF_GET(in_dev, NOPOLICY))
@@ -2473,6 +2071,9 @@ static int __mkroute_output(struct rtable **result,
 
 	rth->rt_flags = flags;
 
+	if (rth->rt_type == RTN_UNICAST)
+		rt_init_learned(rth);
+
 	*result = rth;
  cleanup:
 	/* release work reference to inet device */
@@ -2489,14 +2090,33 @@ static int ip_mkroute_output(struct rtable **rp,
 			     unsigned flags)
 {
 	struct rtable *rth = NULL;
-	int err = __mkroute_output(&rth, res, fl, oldflp, dev_out, flags);
-	unsigned hash;
-	if (err == 0) {
-		hash = rt_hash(oldflp->fl4_dst, oldflp->fl4_src, oldflp->oif,
-			       rt_genid(dev_net(dev_out)));
-		err = rt_intern_hash(hash, rth, rp, NULL);
+	struct rt_nh_cache **cachep = NULL;
+	unsigned hash = 0;
+	int err;
+
+	if (res->fi) {
+		cachep = &FIB_RES_NH(*res).nh_rth_output;
+		hash = rt_nh_hash(oldflp->fl4_dst, oldflp->fl4_src,
+				  oldflp->oif);
+		rth = rt_nh_cache_output(cachep, hash, oldflp);
+		if (rth) {
+			*rp = rth;
+			return 0;
+		}
 	}
 
+	err = __mkroute_output(&rth, res, fl, oldflp, dev_out, flags);
+	if (err)
+		return err;
+
+	/* __mkroute_output() drops the fib_info of routes it does not
+	 * want resolved through the nexthop.
+	 */
+	if (!res->fi)
+		cachep = NULL;
+	err = rt_finish(rth, cachep, hash);
+	if (err == 0)
+		*rp = rth;
 	return err;
 }
 
@@ -2708,37 +2328,6 @@ out:	return err;
 int __ip_route_output_key(struct net *net, struct rtable **rp,
 			  const struct flowi *flp)
 {
-	unsigned hash;
-	struct rtable *rth;
-
-	if (!rt_caching(net))
-		goto slow_output;
-
-	hash = rt_hash(flp->fl4_dst, flp->fl4_src, flp->oif, rt_genid(net));
-
-	rcu_read_lock_bh();
-	for (rth = rcu_dereference(rt_hash_table[hash].chain); rth;
-		rth = rcu_dereference(rth->u.dst.rt_next)) {
-		if (rth->fl.fl4_dst == flp->fl4_dst &&
-		    rth->fl.fl4_src == flp->fl4_src &&
-		    rth->fl.iif == 0 &&
-		    rth->fl.oif == flp->oif &&
-		    rth->fl.mark == flp->mark &&
-		    !((rth->fl.fl4_tos ^ flp->fl4_tos) &
-			    (IPTOS_RT_MASK | RTO_ONLINK)) &&
-		    net_eq(dev_net(rth->u.dst.dev), net) &&
-		    !rt_is_expired(rth)) {
-			dst_use(&rth->u.dst, jiffies);
-			RT_CACHE_STAT_INC(out_hit);
-			rcu_read_unlock_bh();
-			*rp = rth;
-			return 0;
-		}
-		RT_CACHE_STAT_INC(out_hlist_search);
-	}
-	rcu_read_unlock_bh();
-
-slow_output:
 	return ip_route_output_slow(net, rp, flp);
 }
 
@@ -3024,45 +2613,9 @@ errout_free:
 	goto errout;
 }
 
+/* Routes are not kept anywhere they could be dumped from. */
 int ip_rt_dump(struct sk_buff *skb,  struct netlink_callback *cb)
 {
-	struct rtable *rt;
-	int h, s_h;
-	int idx, s_idx;
-	struct net *net;
-
-	net = sock_net(skb->sk);
-
-	s_h = cb->args[0];
-	if (s_h < 0)
-		s_h = 0;
-	s_idx = idx = cb->args[1];
-	for (h = s_h; h <= rt_hash_mask; h++, s_idx = 0) {
-		if (!rt_hash_table[h].chain)
-			continue;
-		rcu_read_lock_bh();
-		for (rt = rcu_dereference(rt_hash_table[h].chain), idx = 0; rt;
-		     rt = rcu_dereference(rt->u.dst.rt_next), idx++) {
-			if (!net_eq(dev_net(rt->u.dst.dev), net) || idx < s_idx)
-				continue;
-			if (rt_is_expired(rt))
-				continue;
-			skb_dst_set(skb, dst_clone(&rt->u.dst));
-			if (rt_fill_info(net, skb, NETLINK_CB(cb->skb).pid,
-					 cb->nlh->nlmsg_seq, RTM_NEWROUTE,
-					 1, NLM_F_MULTI) <= 0) {
-				skb_dst_drop(skb);
-				rcu_read_unlock_bh();
-				goto done;
-			}
-			skb_dst_drop(skb);
-		}
-		rcu_read_unlock_bh();
-	}
-
-done:
-	cb->args[0] = h;
-	cb->args[1] = idx;
 	return skb->len;
 }
 
@@ -3110,64 +2663,6 @@ static int ipv4_sysctl_rtcache_flush_strategy(ctl_table *table,
 	return 0;
 }
 
-static void rt_secret_reschedule(int old)
-{
-	struct net *net;
-	int new = ip_rt_secret_interval;
-	int diff = new - old;
-
-	if (!diff)
-		return;
-
-	rtnl_lock();
-	for_each_net(net) {
-		int deleted = del_timer_sync(&net->ipv4.rt_secret_timer);
-
-		if (!new)
-			continue;
-
-		if (deleted) {
-			long time = net->ipv4.rt_secret_timer.expires - jiffies;
-
-			if (time <= 0 || (time += diff) <= 0)
-				time = 0;
-
-			net->ipv4.rt_secret_timer.expires = time;
-		} else
-			net->ipv4.rt_secret_timer.expires = new;
-
-		net->ipv4.rt_secret_timer.expires += jiffies;
-		add_timer(&net->ipv4.rt_secret_timer);
-	}
-	rtnl_unlock();
-}
-
-static int ipv4_sysctl_rt_secret_interval(ctl_table *ctl, int write,
-					  void __user *buffer, size_t *lenp,
-					  loff_t *ppos)
-{
-	int old = ip_rt_secret_interval;
-	int ret = proc_dointvec_jiffies(ctl, write, buffer, lenp, ppos);
-
-	rt_secret_reschedule(old);
-
-	return ret;
-}
-
-static int ipv4_sysctl_rt_secret_interval_strategy(ctl_table *table,
-						   void __user *oldval,
-						   size_t __user *oldlenp,
-						   void __user *newval,
-						   size_t newlen)
-{
-	int old = ip_rt_secret_interval;
-	int ret = sysctl_jiffies(table, oldval, oldlenp, newval, newlen);
-
-	rt_secret_reschedule(old);
-
-	return ret;
-}
-
 static ctl_table ipv4_route_table[] = {
 	{
 		.ctl_name	= NET_IPV4_ROUTE_GC_THRESH,
@@ -3302,8 +2797,8 @@ static ctl_table ipv4_route_table[] = {
 		.data		= &ip_rt_secret_interval,
 		.maxlen		= sizeof(int),
 		.mode		= 0644,
-		.proc_handler	= ipv4_sysctl_rt_secret_interval,
-		.strategy	= ipv4_sysctl_rt_secret_interval_strategy,
+		.proc_handler	= proc_dointvec_jiffies,
+		.strategy	= sysctl_jiffies,
 	},
 	{ .ctl_name = 0 }
 };
@@ -3386,33 +2881,16 @@ static __net_initdata struct pernet_operations sysctl_route_ops = {
 #endif
 
 
-static __net_init int rt_secret_timer_init(struct net *net)
+static __net_init int rt_genid_init(struct net *net)
 {
 	atomic_set(&net->ipv4.rt_genid,
 			(int) ((num_physpages ^ (num_physpages>>8)) ^
 			(jiffies ^ (jiffies >> 7))));
-
-	net->ipv4.rt_secret_timer.function = rt_secret_rebuild;
-	net->ipv4.rt_secret_timer.data = (unsigned long)net;
-	init_timer_deferrable(&net->ipv4.rt_secret_timer);
-
-	if (ip_rt_secret_interval) {
-		net->ipv4.rt_secret_timer.expires =
-			jiffies + net_random() % ip_rt_secret_interval +
-			ip_rt_secret_interval;
-		add_timer(&net->ipv4.rt_secret_timer);
-	}
 	return 0;
 }
 
-static __net_exit void rt_secret_timer_exit(struct net *net)
-{
-	del_timer_sync(&net->ipv4.rt_secret_timer);
-}
-
-static __net_initdata struct pernet_operations rt_secret_timer_ops = {
-	.init = rt_secret_timer_init,
-	.exit = rt_secret_timer_exit,
+static __net_initdata struct pernet_operations rt_genid_ops = {
+	.init = rt_genid_init,
 };
 
 
@@ -3420,19 +2898,11 @@ static __net_initdata struct pernet_operations rt_secret_timer_ops = {
 struct ip_rt_acct *ip_rt_acct __read_mostly;
 #endif /* CONFIG_NET_CLS_ROUTE */
 
-static __initdata unsigned long rhash_entries;
-static int __init set_rhash_entries(char *str)
-{
-	if (!str)
-		return 0;
-	rhash_entries = simple_strtoul(str, &str, 0);
-	return 1;
-}
-__setup("rhash_entries=", set_rhash_entries);
-
 int __init ip_rt_init(void)
 {
+	unsigned long max;
 	int rc = 0;
+	int cpu;
 
 #ifdef CONFIG_NET_CLS_ROUTE
 	ip_rt_acct = __alloc_percpu(256 * sizeof(struct ip_rt_acct), __alignof__(struct ip_rt_acct));
@@ -3446,41 +2916,42 @@ int __init ip_rt_init(void)
 
 	ipv4_dst_blackhole_ops.kmem_cachep = ipv4_dst_ops.kmem_cachep;
 
-	rt_hash_table = (struct rt_hash_bucket *)
-		alloc_large_system_hash("IP route cache",
-					sizeof(struct rt_hash_bucket),
-					rhash_entries,
-					(totalram_pages >= 128 * 1024) ?
-					15 : 17,
-					0,
-					&rt_hash_log,
-					&rt_hash_mask,
-					rhash_entries ? 0 : 512 * 1024);
-	memset(rt_hash_table, 0, (rt_hash_mask + 1) * sizeof(struct rt_hash_bucket));
-	rt_hash_lock_init();
-
-	ipv4_dst_ops.gc_thresh = (rt_hash_mask + 1);
-	ip_rt_max_size = (rt_hash_mask + 1) * 16;
+	for_each_possible_cpu(cpu) {
+		struct rt_dev_list *rl = &per_cpu(rt_dev_list, cpu);
 
-	devinet_init();
-	ip_fib_init();
+		spin_lock_init(&rl->lock);
+		INIT_LIST_HEAD(&rl->head);
+	}
+	get_random_bytes(&rt_nh_rnd, sizeof(rt_nh_rnd));
 
-	/* All the timers, started at system startup tend
-	   to synchronize. Perturb it a bit.
+	/* About a slot per 32KB of memory with 4KB pages, as the route
+	 * hash had, within what __get_free_pages() can hand out.
+	 */
+	max = min_t(unsigned long, totalram_pages >> 3,
+		    (PAGE_SIZE << (MAX_ORDER - 1)) /
+		    (2 * sizeof(struct rtable *)));
+	if (max > RT_NH_CACHE_MIN)
+		rt_nh_cache_max = rounddown_pow_of_two(max);
+
+	/* Grown tables may hold as many routes as the route cache could,
+	 * sixteen times its hash size.
 	 */
-	INIT_DELAYED_WORK_DEFERRABLE(&expires_work, rt_worker_func);
-	expires_ljiffies = jiffies;
-	schedule_delayed_work(&expires_work,
-		net_random() % ip_rt_gc_interval + ip_rt_gc_interval);
+	ip_rt_max_size = min_t(unsigned long, INT_MAX,
+			       max_t(unsigned long, totalram_pages >> 3,
+				     RT_NH_CACHE_MIN) * 16);
+	ipv4_dst_ops.gc_thresh = ~0;
+
+	devinet_init();
+	ip_fib_init();
 
-	if (register_pernet_subsys(&rt_secret_timer_ops))
-		printk(KERN_ERR "Unable to setup rt_secret_timer\n");
+	if (register_pernet_subsys(&rt_genid_ops))
+		printk(KERN_ERR "Unable to setup rt_genid\n");
 
 	if (ip_rt_proc_init())
 		printk(KERN_ERR "Unable to create route proc files\n");
 #ifdef CONFIG_XFRM
 	xfrm_init();
-	xfrm4_init(ip_rt_max_size);
+	xfrm4_init();
 #endif
 	rtnl_register(PF_INET, RTM_GETROUTE, inet_rtm_getroute, NULL, NULL);
 
@@ -0,0 +1,246 @@
+/*
+ * TCP Fast Open: data in the SYN for connections to servers seen before.
+ *
+ * The server hands out an AES based cookie bound to the client address.
+ * A client that presents a valid cookie in a later SYN gets the data
+ * carried by that SYN delivered to the application right away, one RTT
+ * before the three-way handshake completes. Clients remember the cookie
+ * (and the MSS) of each server in a small per-destination cache.
+ *
+ *	This program is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License
+ *	as published by the Free Software Foundation; either version
+ *	2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/crypto.h>
+#include <linux/cache.h>
+#include <linux/hash.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/random.h>
+#include <linux/rcupdate.h>
+#include <linux/spinlock.h>
+#include <net/tcp.h>
+
+int sysctl_tcp_fastopen __read_mostly = TFO_CLIENT_ENABLE;
+
+struct tcp_fastopen_context {
+	struct crypto_cipher	*tfm;
+	__u8			key[TCP_FASTOPEN_KEY_LENGTH];
+	struct rcu_head		rcu;
+};
+
+static struct tcp_fastopen_context *tcp_fastopen_ctx;
+
+static DEFINE_SPINLOCK(tcp_fastopen_ctx_lock);
+
+static void tcp_fastopen_ctx_free(struct rcu_head *head)
+{
+	struct tcp_fastopen_context *ctx =
+	    container_of(head, struct tcp_fastopen_context, rcu);
+	crypto_free_cipher(ctx->tfm);
+	kfree(ctx);
+}
+
+int tcp_fastopen_reset_cipher(void *key, unsigned int len)
+{
+	int err;
+	struct tcp_fastopen_context *ctx, *octx;
+
+	ctx = kmalloc(sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		return -ENOMEM;
+	ctx->tfm = crypto_alloc_cipher("aes", 0, 0);
+
+	if (IS_ERR(ctx->tfm)) {
+		err = PTR_ERR(ctx->tfm);
+error:		kfree(ctx);
+		pr_err("TCP: TFO aes cipher alloc error: %d\n", err);
+		return err;
+	}
+	err = crypto_cipher_setkey(ctx->tfm, key, len);
+	if (err) {
+		pr_err("TCP: TFO cipher key error: %d\n", err);
+		crypto_free_cipher(ctx->tfm);
+		goto error;
+	}
+	memcpy(ctx->key, key, len);
+
+	spin_lock(&tcp_fastopen_ctx_lock);
+	octx = tcp_fastopen_ctx;
+	rcu_assign_pointer(tcp_fastopen_ctx, ctx);
+	spin_unlock(&tcp_fastopen_ctx_lock);
+
+	if (octx)
+		call_rcu(&octx->rcu, tcp_fastopen_ctx_free);
+	return err;
+}
+
+void tcp_fastopen_get_key(void *key)
+{
+	struct tcp_fastopen_context *ctx;
+
+	rcu_read_lock();
+	ctx = rcu_dereference(tcp_fastopen_ctx);
+	if (ctx)
+		memcpy(key, ctx->key, TCP_FASTOPEN_KEY_LENGTH);
+	else
+		memset(key, 0, TCP_FASTOPEN_KEY_LENGTH);
+	rcu_read_unlock();
+}
+
+/* Computes the fastopen cookie for the peer.
+ * The peer address is a 128 bits long (pad with zeros for IPv4).
+ *
+ * The caller must check foc->len to determine if a valid cookie
+ * has been generated successfully.
+ */
+void tcp_fastopen_cookie_gen(__be32 addr, struct tcp_fastopen_cookie *foc)
+{
+	__be32 peer_addr[4] = { addr, 0, 0, 0 };
+	struct tcp_fastopen_context *ctx;
+
+	rcu_read_lock();
+	ctx = rcu_dereference(tcp_fastopen_ctx);
+	if (ctx) {
+		crypto_cipher_encrypt_one(ctx->tfm, foc->val,
+					  (__u8 *)peer_addr);
+		foc->len = TCP_FASTOPEN_COOKIE_SIZE;
+	}
+	rcu_read_unlock();
+}
+
+/* Release the request kept by a passive Fast Open child to retransmit
+ * its SYN-ACK, and the slot it holds in the listener's Fast Open queue.
+ * Called once the handshake completes or the child goes away.
+ */
+void tcp_fastopen_release_rsk(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct sock *listener = tp->fastopen_listener;
+
+	if (tp->fastopen_rsk == NULL)
+		return;
+
+	reqsk_free(tp->fastopen_rsk);
+	tp->fastopen_rsk = NULL;
+	tp->fastopen_listener = NULL;
+
+	atomic_dec(&tcp_sk(listener)->fastopen_qlen);
+	sock_put(listener);
+}
+
+/*
+ * Client side cache of the cookie and MSS last announced by each server,
+ * plus recent history of SYN-data losses to that server. Entries are
+ * hashed on the destination address; each chain is bounded and its
+ * least recently updated entry is recycled when it is full.
+ */
+#define TFO_CACHE_HASH_BITS	10
+#define TFO_CACHE_DEPTH		5
+
+struct tcp_fastopen_cache {
+	struct hlist_node		node;
+	struct net			*net;
+	__be32				daddr;
+	u16				mss;
+	u16				syn_loss;
+	unsigned long			last_syn_loss;
+	unsigned long			stamp;
+	struct tcp_fastopen_cookie	cookie;
+};
+
+static struct hlist_head tfo_cache_hash[1 << TFO_CACHE_HASH_BITS];
+static DEFINE_SPINLOCK(tfo_cache_lock);
+
+static struct hlist_head *tfo_cache_bucket(__be32 daddr)
+{
+	return &tfo_cache_hash[hash_32((__force u32)daddr,
+				       TFO_CACHE_HASH_BITS)];
+}
+
+static struct tcp_fastopen_cache *tfo_cache_lookup(struct net *net,
+						   __be32 daddr, bool create)
+{
+	struct hlist_head *head = tfo_cache_bucket(daddr);
+	struct tcp_fastopen_cache *tfoc, *oldest = NULL;
+	struct hlist_node *node;
+	int depth = 0;
+
+	hlist_for_each_entry(tfoc, node, head, node) {
+		if (tfoc->daddr == daddr && net_eq(tfoc->net, net))
+			return tfoc;
+		if (!oldest || time_before(tfoc->stamp, oldest->stamp))
+			oldest = tfoc;
+		depth++;
+	}
+	if (!create)
+		return NULL;
+
+	if (depth >= TFO_CACHE_DEPTH) {
+		hlist_del(&oldest->node);
+		tfoc = oldest;
+	} else {
+		tfoc = kmalloc(sizeof(*tfoc), GFP_ATOMIC);
+		if (!tfoc)
+			return NULL;
+	}
+	memset(tfoc, 0, sizeof(*tfoc));
+	tfoc->net = net;
+	tfoc->daddr = daddr;
+	hlist_add_head(&tfoc->node, head);
+	return tfoc;
+}
+
+void tcp_fastopen_cache_get(struct sock *sk, u16 *mss,
+			    struct tcp_fastopen_cookie *cookie,
+			    int *syn_loss, unsigned long *last_syn_loss)
+{
+	struct tcp_fastopen_cache *tfoc;
+
+	spin_lock_bh(&tfo_cache_lock);
+	tfoc = tfo_cache_lookup(sock_net(sk), inet_sk(sk)->daddr, false);
+	if (tfoc) {
+		if (tfoc->mss)
+			*mss = tfoc->mss;
+		*cookie = tfoc->cookie;
+		*syn_loss = tfoc->syn_loss;
+		*last_syn_loss = *syn_loss ? tfoc->last_syn_loss : 0;
+	}
+	spin_unlock_bh(&tfo_cache_lock);
+}
+
+void tcp_fastopen_cache_set(struct sock *sk, u16 mss,
+			    struct tcp_fastopen_cookie *cookie, bool syn_lost)
+{
+	struct tcp_fastopen_cache *tfoc;
+
+	spin_lock_bh(&tfo_cache_lock);
+	tfoc = tfo_cache_lookup(sock_net(sk), inet_sk(sk)->daddr, true);
+	if (tfoc) {
+		if (mss)
+			tfoc->mss = mss;
+		if (cookie->len > 0)
+			tfoc->cookie = *cookie;
+		if (syn_lost) {
+			++tfoc->syn_loss;
+			tfoc->last_syn_loss = jiffies;
+		} else
+			tfoc->syn_loss = 0;
+		tfoc->stamp = jiffies;
+	}
+	spin_unlock_bh(&tfo_cache_lock);
+}
+
+static int __init tcp_fastopen_init(void)
+{
+	__u8 key[TCP_FASTOPEN_KEY_LENGTH];
+
+	get_random_bytes(key, sizeof(key));
+	tcp_fastopen_reset_cipher(key, sizeof(key));
+	return 0;
+}
+
+late_initcall(tcp_fastopen_init);
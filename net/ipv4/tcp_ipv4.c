@@ -72,6 +72,7 @@
 #include <net/xfrm.h>
 #include <net/netdma.h>
 #include <net/secure_seq.h>
+#include <net/busy_poll.h>
 
 #include <linux/inet.h>
 #include <linux/ipv6.h>
@@ -84,6 +85,7 @@
 
 int sysctl_tcp_tw_reuse __read_mostly;
 int sysctl_tcp_low_latency __read_mostly;
+int sysctl_tcp_lockless_syn __read_mostly = 1;
 
 
 #ifdef CONFIG_TCP_MD5SIG
@@ -742,10 +744,34 @@ static void tcp_v4_reqsk_send_ack(struct sock *sk, struct sk_buff *skb,
  *	This still operates on a request_sock only, not on a big
  *	socket.
  */
-static int __tcp_v4_send_synack(struct sock *sk, struct request_sock *req,
-				struct dst_entry *dst)
+static int __tcp_v4_xmit_synack(struct sock *sk, struct sk_buff *skb,
+				__be32 saddr, __be32 daddr,
+				struct ip_options *opt)
+{
+	struct tcphdr *th = tcp_hdr(skb);
+	int err;
+
+	th->check = tcp_v4_check(skb->len, saddr, daddr,
+				 csum_partial(th, skb->len,
+					      skb->csum));
+
+	err = ip_build_and_send_pkt(skb, sk, saddr, daddr, opt);
+	return net_xmit_eval(err);
+}
+
+static int tcp_v4_xmit_synack(struct sock *sk, struct request_sock *req,
+			      struct sk_buff *skb)
 {
 	const struct inet_request_sock *ireq = inet_rsk(req);
+
+	return __tcp_v4_xmit_synack(sk, skb, ireq->loc_addr, ireq->rmt_addr,
+				    ireq->opt);
+}
+
+static int __tcp_v4_send_synack(struct sock *sk, struct request_sock *req,
+				struct dst_entry *dst,
+				struct tcp_fastopen_cookie *foc)
+{
 	int err = -1;
 	struct sk_buff * skb;
 
@@ -753,22 +779,10 @@ static int __tcp_v4_send_synack(struct sock *sk, struct request_sock *req,
 	if (!dst && (dst = inet_csk_route_req(sk, req)) == NULL)
 		return -1;
 
-	skb = tcp_make_synack(sk, dst, req);
-
-	if (skb) {
-		struct tcphdr *th = tcp_hdr(skb);
+	skb = __tcp_make_synack(sk, dst, req, foc);
 
-		th->check = tcp_v4_check(skb->len,
-					 ireq->loc_addr,
-					 ireq->rmt_addr,
-					 csum_partial(th, skb->len,
-						      skb->csum));
-
-		err = ip_build_and_send_pkt(skb, sk, ireq->loc_addr,
-					    ireq->rmt_addr,
-					    ireq->opt);
-		err = net_xmit_eval(err);
-	}
+	if (skb)
+		err = tcp_v4_xmit_synack(sk, req, skb);
 
 	dst_release(dst);
 	return err;
@@ -776,7 +790,7 @@ static int __tcp_v4_send_synack(struct sock *sk, struct request_sock *req,
 
 static int tcp_v4_send_synack(struct sock *sk, struct request_sock *req)
 {
-	return __tcp_v4_send_synack(sk, req, NULL);
+	return __tcp_v4_send_synack(sk, req, NULL, NULL);
 }
 
 /*
@@ -1210,8 +1224,169 @@ static struct timewait_sock_ops tcp_timewait_sock_ops = {
 	.twsk_destructor= tcp_twsk_destructor,
 };
 
+/* Decide whether the SYN in @skb may open a Fast Open connection. Returns
+ * true if the data it carries should be accepted right away; otherwise
+ * @valid_foc may be set to a cookie to hand out in the SYN-ACK.
+ */
+static bool tcp_v4_fastopen_check(struct sock *sk, struct sk_buff *skb,
+				  struct request_sock *req,
+				  struct tcp_fastopen_cookie *foc,
+				  struct tcp_fastopen_cookie *valid_foc)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	bool has_data = TCP_SKB_CB(skb)->end_seq != TCP_SKB_CB(skb)->seq + 1;
+	bool skip_cookie = false;
+
+	if (likely(foc->len < 0)) {
+		if ((sysctl_tcp_fastopen & TFO_SERVER_COOKIE_NOT_REQD) &&
+		    has_data)
+			skip_cookie = true; /* no cookie to validate */
+		else
+			return false;
+	}
+	/* A Fast Open option is present; bump the counter. */
+	NET_INC_STATS_BH(sock_net(sk), LINUX_MIB_TCPFASTOPENPASSIVE);
+
+	if (!(sysctl_tcp_fastopen & TFO_SERVER_ENABLE) ||
+	    tp->fastopen_max_qlen == 0)
+		return false;
+
+	if (atomic_read(&tp->fastopen_qlen) >= tp->fastopen_max_qlen ||
+	    sk_acceptq_is_full(sk)) {
+		NET_INC_STATS_BH(sock_net(sk),
+				 LINUX_MIB_TCPFASTOPENLISTENOVERFLOW);
+		return false;
+	}
+
+	if (skip_cookie) {
+		tcp_rsk(req)->rcv_nxt = TCP_SKB_CB(skb)->end_seq;
+		return true;
+	}
+
+	tcp_fastopen_cookie_gen(ip_hdr(skb)->saddr, valid_foc);
+	if (foc->len == 0) {
+		/* Client requesting a cookie */
+		NET_INC_STATS_BH(sock_net(sk), LINUX_MIB_TCPFASTOPENCOOKIEREQD);
+		return false;
+	}
+	/* A cookie of the wrong size is treated as invalid: answer with
+	 * the valid one, and accept data only with a matching cookie.
+	 */
+	if (foc->len != TCP_FASTOPEN_COOKIE_SIZE ||
+	    valid_foc->len != TCP_FASTOPEN_COOKIE_SIZE ||
+	    memcmp(foc->val, valid_foc->val, TCP_FASTOPEN_COOKIE_SIZE))
+		return false;
+
+	valid_foc->len = -1;
+	if (!has_data)
+		return false;
+
+	/* Acknowledge the data received from the peer. */
+	tcp_rsk(req)->rcv_nxt = TCP_SKB_CB(skb)->end_seq;
+	return true;
+}
+
+/* Create a child socket straight out of a Fast Open SYN, hand it to the
+ * accept queue together with the data the SYN carried and answer with a
+ * SYN-ACK. The child stays in SYN_RECV, retransmitting the SYN-ACK from
+ * a private copy of @req, until the final ACK of the handshake arrives.
+ */
+static int tcp_v4_conn_req_fastopen(struct sock *sk, struct sk_buff *skb,
+				    struct request_sock *req,
+				    struct dst_entry *dst)
+{
+	struct sk_buff *skb_synack;
+	struct request_sock *rsk;
+	struct tcp_sock *tp;
+	struct sock *child;
+
+	if (!dst && (dst = inet_csk_route_req(sk, req)) == NULL)
+		goto fail;
+
+	/* Building the SYN-ACK also sets up the receive window the child
+	 * inherits from the request, so it has to come first.
+	 */
+	skb_synack = __tcp_make_synack(sk, dst, req, NULL);
+	rsk = reqsk_alloc(req->rsk_ops);
+	if (skb_synack == NULL || rsk == NULL) {
+		kfree_skb(skb_synack);
+		if (rsk)
+			__reqsk_free(rsk);
+		dst_release(dst);
+		goto fail;
+	}
+
+	child = inet_csk(sk)->icsk_af_ops->syn_recv_sock(sk, skb, req, dst);
+	if (child == NULL) {
+		kfree_skb(skb_synack);
+		__reqsk_free(rsk);
+		goto fail;
+	}
+	tcp_v4_xmit_synack(sk, req, skb_synack);
+
+	/* IP options moved to the child above, so the copy owns nothing */
+	memcpy(rsk, req, req->rsk_ops->obj_size);
+	rsk->dl_next = NULL;
+	rsk->sk = NULL;
+
+	tp = tcp_sk(child);
+	tp->fastopen_rsk = rsk;
+	/* Hold the listener so that its Fast Open accounting outlives it
+	 * if it is closed while the child is still in SYN_RECV.
+	 */
+	sock_hold(sk);
+	tp->fastopen_listener = sk;
+	atomic_inc(&tcp_sk(sk)->fastopen_qlen);
+
+	/* RFC1323: The window in SYN & SYN/ACK segments is never
+	 * scaled. So correct it appropriately.
+	 */
+	tp->snd_wnd = ntohs(tcp_hdr(skb)->window);
+
+	/* Activate the retrans timer so that SYNACK can be retransmitted.
+	 * The request socket is not added to the SYN table of the parent
+	 * because it's been added to the accept queue directly.
+	 */
+	inet_csk_reset_xmit_timer(child, ICSK_TIME_RETRANS,
+				  TCP_TIMEOUT_INIT, TCP_RTO_MAX);
+
+	/* Add the child socket directly into the accept queue */
+	inet_csk_reqsk_queue_add(sk, req, child);
+
+	/* Now finish processing the fastopen child socket. */
+	inet_csk(child)->icsk_af_ops->rebuild_header(child);
+	tcp_init_metrics(child);
+	tcp_init_congestion_control(child);
+	tcp_mtup_init(child);
+	tcp_initialize_rcv_mss(child);
+	tcp_init_buffer_space(child);
+	tp->lsndtime = tcp_time_stamp;
+
+	/* Queue the data carried in the SYN. We need to first bump skb's
+	 * refcnt because the caller will attempt to free it.
+	 */
+	skb = skb_get(skb);
+	skb_dst_drop(skb);
+	__skb_pull(skb, tcp_hdrlen(skb));
+	skb_set_owner_r(skb, child);
+	__skb_queue_tail(&child->sk_receive_queue, skb);
+	tp->rcv_nxt = TCP_SKB_CB(skb)->end_seq;
+	tp->syn_data_acked = 1;
+
+	sk->sk_data_ready(sk, 0);
+	bh_unlock_sock(child);
+	sock_put(child);
+	return 0;
+
+fail:
+	NET_INC_STATS_BH(sock_net(sk), LINUX_MIB_TCPFASTOPENPASSIVEFAIL);
+	return -1;
+}
+
 int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 {
+	struct tcp_fastopen_cookie foc = { .len = -1 };
+	struct tcp_fastopen_cookie valid_foc = { .len = -1 };
 	struct inet_request_sock *ireq;
 	struct tcp_options_received tmp_opt;
 	struct request_sock *req;
@@ -1219,6 +1394,8 @@ int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 	__be32 daddr = ip_hdr(skb)->daddr;
 	__u32 isn = TCP_SKB_CB(skb)->when;
 	struct dst_entry *dst = NULL;
+	struct sk_buff *skb_synack;
+	struct ip_options *opt;
 #ifdef CONFIG_SYN_COOKIES
 	int want_cookie = 0;
 #else
@@ -1262,7 +1439,7 @@ int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 	tmp_opt.mss_clamp = 536;
 	tmp_opt.user_mss  = tcp_sk(sk)->rx_opt.user_mss;
 
-	tcp_parse_options(skb, &tmp_opt, 0);
+	__tcp_parse_options(skb, &tmp_opt, 0, want_cookie ? NULL : &foc);
 
 	if (want_cookie && !tmp_opt.saw_tstamp)
 		tcp_clear_options(&tmp_opt);
@@ -1336,10 +1513,40 @@ int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 	tcp_rsk(req)->snt_isn = isn;
 	tcp_rsk(req)->snt_synack = tcp_time_stamp;
 
-	if (__tcp_v4_send_synack(sk, req, dst) || want_cookie)
+	if (!want_cookie &&
+	    tcp_v4_fastopen_check(sk, skb, req, &foc, &valid_foc)) {
+		if (tcp_v4_conn_req_fastopen(sk, skb, req, dst))
+			goto drop_and_free;
+		return 0;
+	}
+
+	/* Build the SYN-ACK while the request is still private to us; once
+	 * it is hashed, the listener-locked path may answer or free it.
+	 */
+	if (!dst && (dst = inet_csk_route_req(sk, req)) == NULL)
+		goto drop_and_free;
+	skb_synack = __tcp_make_synack(sk, dst, req, &valid_foc);
+	if (!skb_synack)
+		goto drop_and_release;
+	dst_release(dst);
+
+	if (want_cookie) {
+		tcp_v4_xmit_synack(sk, req, skb_synack);
 		goto drop_and_free;
+	}
 
-	inet_csk_reqsk_queue_hash_add(sk, req, TCP_TIMEOUT_INIT);
+	/* A copy of this SYN handled without the listener lock on another
+	 * CPU may already have queued a request for the same 4-tuple, with
+	 * its own ISN. Only that one may answer. Lockless SYNs never carry
+	 * IP options, so @opt is not freed under us by a concurrent drop.
+	 */
+	opt = ireq->opt;
+	if (!inet_csk_reqsk_queue_hash_add_unique(sk, req, TCP_TIMEOUT_INIT)) {
+		kfree_skb(skb_synack);
+		goto drop_and_free;
+	}
+	/* if this fails, the SYN-ACK timer sends it again */
+	__tcp_v4_xmit_synack(sk, skb_synack, daddr, saddr, opt);
 	return 0;
 
 drop_and_release:
@@ -1572,6 +1779,83 @@ csum_err:
 	goto discard;
 }
 
+/*
+ * A pure SYN for an IPv4 listener only allocates a request_sock and hashes
+ * it into the SYN queue, which is serialized by syn_wait_lock. Handle it
+ * here without the listener lock so SYN processing scales with the number
+ * of RX queues. Anything else, including a SYN retransmit that matches a
+ * pending request, falls back to the locked path.
+ *
+ * Returns 1 if the skb was consumed.
+ */
+static int tcp_v4_rcv_listen_syn(struct sock *sk, struct sk_buff *skb)
+{
+	struct request_sock_queue *queue = &inet_csk(sk)->icsk_accept_queue;
+	const struct tcphdr *th = tcp_hdr(skb);
+	const struct iphdr *iph = ip_hdr(skb);
+	struct request_sock *req, **prev;
+
+	if (!sysctl_tcp_lockless_syn || sk->sk_family != AF_INET)
+		return 0;
+
+	if (!th->syn || th->ack || th->rst || th->fin)
+		return 0;
+
+	/* Data in a Fast Open SYN may turn into a child socket on the
+	 * accept queue right away, which needs the listener lock.
+	 */
+	if (skb->len > tcp_hdrlen(skb))
+		return 0;
+
+	/* The request would own a copy of the options, which the locked
+	 * path may free while we are still sending the SYN-ACK.
+	 */
+	if (iph->ihl > 5)
+		return 0;
+
+#ifdef CONFIG_TCP_MD5SIG
+	/* keys are changed under the socket lock */
+	if (tcp_sk(sk)->md5sig_info)
+		return 0;
+	if (tcp_v4_inbound_md5_hash(sk, skb))
+		goto discard;
+#endif
+
+	if (skb->len < tcp_hdrlen(skb) || tcp_checksum_complete(skb)) {
+		TCP_INC_STATS_BH(sock_net(sk), TCP_MIB_INERRS);
+		goto discard;
+	}
+
+	/* inet_csk_listen_stop() waits for us before freeing listen_opt,
+	 * provided it sees rskq_lockless; pairs with the smp_mb() there.
+	 */
+	rcu_read_lock();
+	if (!queue->rskq_lockless)
+		queue->rskq_lockless = 1;
+	smp_mb();
+	if (sk->sk_state != TCP_LISTEN) {
+		rcu_read_unlock();
+		return 0;
+	}
+
+	read_lock(&queue->syn_wait_lock);
+	req = inet_csk_search_req(sk, &prev, th->source,
+				  iph->saddr, iph->daddr);
+	read_unlock(&queue->syn_wait_lock);
+	if (req) {
+		rcu_read_unlock();
+		return 0;
+	}
+
+	if (tcp_v4_conn_request(sk, skb) < 0)
+		tcp_v4_send_reset(sk, skb);
+	rcu_read_unlock();
+
+discard:
+	kfree_skb(skb);
+	return 1;
+}
+
 /*
  *	From tcp_input.c
  */
@@ -1637,10 +1921,16 @@ process:
 	if (sk_filter(sk, skb))
 		goto discard_and_relse;
 
+	sk_mark_napi_id(sk, skb);
 	skb->dev = NULL;
 
 	inet_rps_save_rxhash(sk, skb->rxhash);
 
+	if (sk->sk_state == TCP_LISTEN && tcp_v4_rcv_listen_syn(sk, skb)) {
+		sock_put(sk);
+		return 0;
+	}
+
 	bh_lock_sock_nested(sk);
 	ret = 0;
 	if (!sock_owned_by_user(sk)) {
@@ -1899,6 +2189,12 @@ void tcp_v4_destroy_sock(struct sock *sk)
 	if (inet_csk(sk)->icsk_bind_hash)
 		inet_put_port(sk);
 
+	/* A Fast Open child that never completed its handshake. */
+	tcp_fastopen_release_rsk(sk);
+
+	/* TCP Fast Open request left over from an interrupted sendmsg(). */
+	tcp_free_fastopen_req(tp);
+
 	/*
 	 * If sendmsg cached page exists, toss it.
 	 */
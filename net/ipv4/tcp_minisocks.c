@@ -401,6 +401,15 @@ struct sock *tcp_create_openreq_child(struct sock *sk, struct request_sock *req,
 		tcp_prequeue_init(newtp);
 		INIT_LIST_HEAD(&newtp->tsq_node);
 
+		newtp->syn_fastopen = 0;
+		newtp->syn_data = 0;
+		newtp->syn_data_acked = 0;
+		newtp->fastopen_req = NULL;
+		newtp->fastopen_rsk = NULL;
+		newtp->fastopen_listener = NULL;
+		atomic_set(&newtp->fastopen_qlen, 0);
+		newtp->fastopen_max_qlen = 0;
+
 		tcp_init_wl(newtp, treq->rcv_isn);
 
 		newtp->srtt = 0;
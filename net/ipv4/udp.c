@@ -105,6 +105,8 @@
 #include <net/route.h>
 #include <net/checksum.h>
 #include <net/xfrm.h>
+#include <net/sock_reuseport.h>
+#include <net/busy_poll.h>
 #include <trace/events/udp.h>
 #include "udp_impl.h"
 
@@ -155,6 +157,32 @@ static int udp_lib_lport_inuse(struct net *net, __u16 num,
 	return 0;
 }
 
+/*
+ * Attach an IPv4 socket to the SO_REUSEPORT group of an identically bound
+ * socket on the same port, or start a new group. Sockets that end up
+ * without a group are still found by the chain walk in __udp4_lib_lookup().
+ */
+static int udp_reuseport_add_sock(struct sock *sk, struct udp_hslot *hslot)
+{
+	struct net *net = sock_net(sk);
+	uid_t uid = sock_i_uid(sk);
+	struct sock *sk2;
+	struct hlist_nulls_node *node;
+
+	sk_nulls_for_each(sk2, node, &hslot->head) {
+		if (net_eq(sock_net(sk2), net) &&
+		    sk2 != sk &&
+		    sk2->sk_family == sk->sk_family &&
+		    sk2->sk_hash == sk->sk_hash &&
+		    sk2->sk_bound_dev_if == sk->sk_bound_dev_if &&
+		    inet_sk(sk2)->rcv_saddr == inet_sk(sk)->rcv_saddr &&
+		    sk2->sk_reuseport && uid == sock_i_uid(sk2))
+			return reuseport_add_sock(sk, sk2);
+	}
+
+	return reuseport_alloc(sk);
+}
+
 /**
  *  udp_lib_get_port  -  UDP/-Lite port lookup for IPv4 and IPv6
  *
@@ -219,6 +247,8 @@ found:
 	inet_sk(sk)->num = snum;
 	sk->sk_hash = snum;
 	if (sk_unhashed(sk)) {
+		if (sk->sk_reuseport && sk->sk_family == PF_INET)
+			udp_reuseport_add_sock(sk, hslot);
 		sk_nulls_add_node_rcu(sk, &hslot->head);
 		sock_prot_inuse_add(sock_net(sk), sk->sk_prot, 1);
 	}
@@ -286,17 +316,21 @@ static struct sock *__udp4_lib_lookup(struct net *net, __be32 saddr,
 		__be16 sport, __be32 daddr, __be16 dport,
 		int dif, struct udp_table *udptable)
 {
-	struct sock *sk, *result;
+	struct sock *sk, *result, *group;
 	struct hlist_nulls_node *node;
 	unsigned short hnum = ntohs(dport);
 	unsigned int slot = udp_hashfn(net, hnum);
 	struct udp_hslot *hslot = &udptable->hash[slot];
 	int score, badness, matches = 0, reuseport = 0;
+	/* best score compute_score() can give for this key */
+	int maxscore = 2 + 4 + 4 + 4 + (dif ? 4 : 0);
+	bool use_group = true;
 	u32 hash = 0;
 
 	rcu_read_lock();
 begin:
 	result = NULL;
+	group = NULL;
 	badness = 0;
 	sk_nulls_for_each_rcu(sk, node, &hslot->head) {
 		score = compute_score(sk, net, saddr, hnum, sport,
@@ -305,9 +339,14 @@ begin:
 			result = sk;
 			badness = score;
 			reuseport = sk->sk_reuseport;
+			group = NULL;
 			if (reuseport) {
 				hash = inet_ehashfn(net, daddr, hnum,
 						    saddr, htons(sport));
+				group = sk;
+				/* a fully specified match can't be beaten */
+				if (score == maxscore)
+					goto select;
 				matches = 1;
 			}
 		} else if (score == badness && reuseport) {
@@ -325,12 +364,25 @@ begin:
 	if (get_nulls_value(node) != slot)
 		goto begin;
 
+select:
+	/* a more specific socket may follow a wildcard group on the
+	 * chain, so the group only picks once the best score is known
+	 */
+	if (group && use_group) {
+		sk = reuseport_select_sock(group, hash);
+		if (sk)
+			result = sk;
+	}
 	if (result) {
 		if (unlikely(!atomic_inc_not_zero(&result->sk_refcnt)))
 			result = NULL;
 		else if (unlikely(compute_score(result, net, saddr, hnum, sport,
 				  daddr, dport, dif) < badness)) {
 			sock_put(result);
+			/* a group member may have been connected or rebound
+			 * since it joined; score the chain the slow way
+			 */
+			use_group = false;
 			goto begin;
 		}
 	}
@@ -1107,6 +1159,8 @@ void udp_lib_unhash(struct sock *sk)
 		struct udp_hslot *hslot = &udptable->hash[hash];
 
 		spin_lock_bh(&hslot->lock);
+		if (sk_extended(sk)->sk_reuseport_cb)
+			reuseport_detach_sock(sk);
 		if (sk_nulls_del_node_init_rcu(sk)) {
 			inet_sk(sk)->num = 0;
 			sock_prot_inuse_add(sock_net(sk), sk->sk_prot, -1);
@@ -1122,6 +1176,7 @@ static int __udp_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
 
 	if (inet_sk(sk)->daddr)
 		sock_rps_save_rxhash(sk, skb->rxhash);
+	sk_mark_napi_id(sk, skb);
 
 	rc = sock_queue_rcv_skb(sk, skb);
 	if (rc < 0) {
@@ -274,19 +274,17 @@ static void __exit xfrm4_policy_fini(void)
 	xfrm_policy_unregister_afinfo(&xfrm4_policy_afinfo);
 }
 
-void __init xfrm4_init(int rt_max_size)
+void __init xfrm4_init(void)
 {
 	/*
-	 * Select a default value for the gc_thresh based on the main route
-	 * table hash size.  It seems to me the worst case scenario is when
+	 * The gc_thresh default used to be derived from the route cache
+	 * size, which is gone. It seems to me the worst case scenario is when
 	 * we have ipsec operating in transport mode, in which we create a
 	 * dst_entry per socket.  The xfrm gc algorithm starts trying to remove
-	 * entries at gc_thresh, and prevents new allocations as 2*gc_thresh
-	 * so lets set an initial xfrm gc_thresh value at the rt_max_size/2.
-	 * That will let us store an ipsec connection per route table entry,
-	 * and start cleaning when were 1/2 full
+	 * entries at gc_thresh, and prevents new allocations as 2*gc_thresh,
+	 * so use a fixed value that leaves room for that.
 	 */
-	xfrm4_dst_ops.gc_thresh = rt_max_size/2;
+	xfrm4_dst_ops.gc_thresh = 32768;
 
 	xfrm4_state_init();
 	xfrm4_policy_init();